@@ -0,0 +1,32 @@
+#include "CpuFeatures.h"
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef SIMD_X86
+static bool cpuHasAVX() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	// OS must also save the YMM registers on context switches
+	return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+	return __builtin_cpu_supports("avx");
+#endif
+}
+#endif
+
+namespace CPU_FEATURES {
+
+	bool hasAVX() {
+#ifdef SIMD_X86
+		static const bool avx = cpuHasAVX();
+		return avx;
+#else
+		return false;
+#endif
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// SIMD kernels (vertex conversion, frustum culling) share one x86 check, AVX marker and runtime detection
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// GCC/Clang only emit AVX instructions in functions marked for it, MSVC allows intrinsics anywhere
+#if defined(SIMD_X86) && !defined(_MSC_VER)
+#define TARGET_AVX __attribute__((target("avx")))
+#else
+#define TARGET_AVX
+#endif
+
+namespace CPU_FEATURES {
+	// CPU has AVX and the OS saves the YMM registers (checked once)
+	bool hasAVX();
+}
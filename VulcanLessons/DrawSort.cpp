@@ -0,0 +1,62 @@
+#include "DrawSort.h"
+
+#include <algorithm>
+
+namespace DRAW_SORT {
+	static uint64_t field(uint32_t value, uint32_t bits) {
+		return static_cast<uint64_t>(value) & ((1ull << bits) - 1);
+	}
+
+	uint64_t makeKey(uint32_t pipeline, uint32_t indexType, uint32_t texture, float depth, uint32_t drawIndex) {
+		// Written as "not above 0" so NaN lands on 0 too
+		float clampedDepth = !(depth > 0.0f) ? 0.0f : std::min(depth, 1.0f);
+		uint32_t depthBits = static_cast<uint32_t>(clampedDepth * static_cast<float>((1u << DRAW_KEY_DEPTH_BITS) - 1));
+
+		uint64_t key = field(pipeline, DRAW_KEY_PIPELINE_BITS);
+		key = (key << DRAW_KEY_INDEX_TYPE_BITS) | field(indexType, DRAW_KEY_INDEX_TYPE_BITS);
+		key = (key << DRAW_KEY_TEXTURE_BITS) | field(texture, DRAW_KEY_TEXTURE_BITS);
+		key = (key << DRAW_KEY_DEPTH_BITS) | field(depthBits, DRAW_KEY_DEPTH_BITS);
+		key = (key << DRAW_KEY_DRAW_BITS) | field(drawIndex, DRAW_KEY_DRAW_BITS);
+		return key;
+	}
+
+	uint32_t getDrawIndex(uint64_t key) {
+		return static_cast<uint32_t>(field(static_cast<uint32_t>(key), DRAW_KEY_DRAW_BITS));
+	}
+
+	void radixSort(std::vector<uint64_t>& keys, std::vector<uint64_t>& scratch) {
+		size_t count = keys.size();
+		scratch.resize(count);
+
+		// Histograms of all 8 bytes in one read of the keys
+		std::vector<uint32_t> histograms(8 * 256, 0);
+		for (uint64_t key : keys) {
+			for (uint32_t pass = 0; pass < 8; pass++) {
+				histograms[pass * 256 + ((key >> (pass * 8)) & 0xFF)]++;
+			}
+		}
+
+		for (uint32_t pass = 0; pass < 8; pass++) {
+			uint32_t* histogram = &histograms[pass * 256];
+
+			// Every key has the same byte here, order would not change
+			if (count == 0 || histogram[(keys[0] >> (pass * 8)) & 0xFF] == count) {
+				continue;
+			}
+
+			// Bucket starts
+			uint32_t offset = 0;
+			for (uint32_t bucket = 0; bucket < 256; bucket++) {
+				uint32_t bucketCount = histogram[bucket];
+				histogram[bucket] = offset;
+				offset += bucketCount;
+			}
+
+			// Stable scatter keeps the order of the lower bytes sorted so far
+			for (uint64_t key : keys) {
+				scratch[histogram[(key >> (pass * 8)) & 0xFF]++] = key;
+			}
+			keys.swap(scratch);
+		}
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Draw sort key, most significant first: pipeline | index type | texture descriptor | depth | draw index.
+// Sorting by it groups draws sharing state (fewest binds first), then front to back inside a group
+const uint32_t DRAW_KEY_DRAW_BITS = 22;
+const uint32_t DRAW_KEY_DEPTH_BITS = 24;
+const uint32_t DRAW_KEY_TEXTURE_BITS = 16;
+const uint32_t DRAW_KEY_INDEX_TYPE_BITS = 1;
+const uint32_t DRAW_KEY_PIPELINE_BITS = 1;
+
+namespace DRAW_SORT {
+	// depth is 0 (near) .. 1 (far), values outside are clamped. Fields wider than their bits are masked
+	uint64_t makeKey(uint32_t pipeline, uint32_t indexType, uint32_t texture, float depth, uint32_t drawIndex);
+	uint32_t getDrawIndex(uint64_t key);
+
+	// LSD radix sort, 8 bits per pass (passes where every key has the same byte are skipped). scratch is resized as needed
+	void radixSort(std::vector<uint64_t>& keys, std::vector<uint64_t>& scratch);
+}
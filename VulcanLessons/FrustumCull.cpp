@@ -0,0 +1,152 @@
+#include "FrustumCull.h"
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "CpuFeatures.h"
+
+void BoxBatch::clear() {
+	centerX.clear(); centerY.clear(); centerZ.clear();
+	extentX.clear(); extentY.clear(); extentZ.clear();
+}
+
+void BoxBatch::push(const glm::vec3& center, const glm::vec3& extent) {
+	centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+	extentX.push_back(extent.x); extentY.push_back(extent.y); extentZ.push_back(extent.z);
+}
+
+// Box is outside a plane when its center is further behind it than the box reaches towards it:
+// n.c + w < -(|nx| ex + |ny| ey + |nz| ez)
+static void cullScalar(const BoxBatch& boxes, const glm::vec4 planes[6], size_t first, uint8_t* visible) {
+	for (size_t i = first; i < boxes.size(); i++) {
+		uint8_t inside = 1;
+		for (int p = 0; p < 6 && inside; p++) {
+			float distance = planes[p].x * boxes.centerX[i] + planes[p].y * boxes.centerY[i] + planes[p].z * boxes.centerZ[i] + planes[p].w;
+			float reach = fabsf(planes[p].x) * boxes.extentX[i] + fabsf(planes[p].y) * boxes.extentY[i] + fabsf(planes[p].z) * boxes.extentZ[i];
+			inside = distance >= -reach ? 1 : 0;
+		}
+		visible[i] = inside;
+	}
+}
+
+#ifdef SIMD_X86
+// Every plane is tested against the whole batch, lanes outside any plane are masked off
+static size_t cullSSE(const BoxBatch& boxes, const glm::vec4 planes[6], uint8_t* visible) {
+	size_t blockEnd = boxes.size() / 4 * 4;
+	for (size_t i = 0; i < blockEnd; i += 4) {
+		__m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+		__m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+		__m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+		__m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+		__m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].x), cx), _mm_mul_ps(_mm_set1_ps(planes[p].y), cy)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].z), cz), _mm_set1_ps(planes[p].w)));
+			__m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(fabsf(planes[p].x)), ex), _mm_mul_ps(_mm_set1_ps(fabsf(planes[p].y)), ey)),
+				_mm_mul_ps(_mm_set1_ps(fabsf(planes[p].z)), ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++) {
+			visible[i + lane] = (mask >> lane) & 1;
+		}
+	}
+	return blockEnd;
+}
+
+TARGET_AVX static size_t cullAVX(const BoxBatch& boxes, const glm::vec4 planes[6], uint8_t* visible) {
+	size_t blockEnd = boxes.size() / 8 * 8;
+	for (size_t i = 0; i < blockEnd; i += 8) {
+		__m256 cx = _mm256_loadu_ps(&boxes.centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&boxes.centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&boxes.extentX[i]);
+		__m256 ey = _mm256_loadu_ps(&boxes.extentY[i]);
+		__m256 ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].x), cx), _mm256_mul_ps(_mm256_set1_ps(planes[p].y), cy)),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].z), cz), _mm256_set1_ps(planes[p].w)));
+			__m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(fabsf(planes[p].x)), ex), _mm256_mul_ps(_mm256_set1_ps(fabsf(planes[p].y)), ey)),
+				_mm256_mul_ps(_mm256_set1_ps(fabsf(planes[p].z)), ez));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (int lane = 0; lane < 8; lane++) {
+			visible[i + lane] = (mask >> lane) & 1;
+		}
+	}
+	return blockEnd;
+}
+#endif
+
+namespace FRUSTUM_CULL {
+
+	CullKernel getBestKernel() {
+#ifdef SIMD_X86
+		static const CullKernel best = CPU_FEATURES::hasAVX() ? CullKernel::AVX : CullKernel::SSE;
+		return best;
+#else
+		return CullKernel::Scalar;
+#endif
+	}
+
+	const char* getKernelName(CullKernel kernel) {
+		switch (kernel) {
+		case CullKernel::SSE: return "SSE";
+		case CullKernel::AVX: return "AVX";
+		default: return "Scalar";
+		}
+	}
+
+	void getFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]) {
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++) {
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+		}
+
+		planes[0] = rows[3] + rows[0];
+		planes[1] = rows[3] - rows[0];
+		planes[2] = rows[3] + rows[1];
+		planes[3] = rows[3] - rows[1];
+		planes[4] = rows[3] + rows[2];
+		planes[5] = rows[3] - rows[2];
+		for (int i = 0; i < 6; i++) {
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+		}
+	}
+
+	void transformBox(const glm::mat4& transform, const glm::vec3& center, const glm::vec3& extent, glm::vec3& worldCenter, glm::vec3& worldExtent) {
+		// Each world axis reaches as far as the absolute transformed box axes add up to (Arvo)
+		worldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+		for (int axis = 0; axis < 3; axis++) {
+			worldExtent[axis] = fabsf(transform[0][axis]) * extent.x + fabsf(transform[1][axis]) * extent.y + fabsf(transform[2][axis]) * extent.z;
+		}
+	}
+
+	void cullBoxes(const BoxBatch& boxes, const glm::vec4 planes[6], std::vector<uint8_t>& visible) {
+		cullBoxes(boxes, planes, visible, getBestKernel());
+	}
+
+	void cullBoxes(const BoxBatch& boxes, const glm::vec4 planes[6], std::vector<uint8_t>& visible, CullKernel kernel) {
+		visible.resize(boxes.size());
+		size_t done = 0;
+#ifdef SIMD_X86
+		if (kernel == CullKernel::AVX && getBestKernel() == CullKernel::AVX) {
+			done = cullAVX(boxes, planes, visible.data());
+		}
+		else if (kernel != CullKernel::Scalar) {
+			done = cullSSE(boxes, planes, visible.data());
+		}
+#endif
+		// Leftover boxes (block loads would read past the end)
+		cullScalar(boxes, planes, done, visible.data());
+	}
+}
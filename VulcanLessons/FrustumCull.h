@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+// Code paths of the box against frustum test
+enum class CullKernel {
+	Scalar,			// Plain loop, any CPU
+	SSE,			// 4 boxes per step
+	AVX				// 8 boxes per step
+};
+
+// World space axis aligned boxes as a structure of arrays, so a batch of boxes loads with one instruction per component
+struct BoxBatch {
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;		// Half size
+
+	void clear();
+	void push(const glm::vec3& center, const glm::vec3& extent);
+	size_t size() const { return centerX.size(); }
+};
+
+namespace FRUSTUM_CULL {
+	// Fastest kernel the running CPU supports (checked once)
+	CullKernel getBestKernel();
+	const char* getKernelName(CullKernel kernel);
+
+	// Frustum planes from the rows of projection * view (Gribb/Hartmann), normalised, inside is positive.
+	// Near plane is z > -w, which is also safe (only looser) for a 0..1 depth range
+	void getFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
+
+	// Box around a transformed box (center, half extent)
+	void transformBox(const glm::mat4& transform, const glm::vec3& center, const glm::vec3& extent, glm::vec3& worldCenter, glm::vec3& worldExtent);
+
+	// visible[i] = 1 if box i is at least partly on the inside of every plane, 0 if it is fully outside one (resized to boxes.size())
+	void cullBoxes(const BoxBatch& boxes, const glm::vec4 planes[6], std::vector<uint8_t>& visible);
+	void cullBoxes(const BoxBatch& boxes, const glm::vec4 planes[6], std::vector<uint8_t>& visible, CullKernel kernel);
+}
@@ -0,0 +1,167 @@
+#include "GeometryArena.h"
+
+#include <iterator>
+#include <stdexcept>
+
+#include "Utils.h"
+
+GeometryArena::GeometryArena(MemoryAllocator* newAllocator, VkDevice newDevice, uint32_t newVertexCapacity, uint32_t newIndexCapacity,
+	uint32_t newMeshletCapacity) {
+	allocator = newAllocator;
+	device = newDevice;
+	vertexCapacity = newVertexCapacity;
+	indexCapacity = newIndexCapacity;
+	meshletCapacity = newMeshletCapacity;
+
+	// All buffers live on the GPU and are only filled through transfers.
+	// Other vertex formats are optional per model, their buffers wait for the first model asking for them
+	createVertexStream(VertexFormat::Full);
+	UTILS::createBuffer(device, allocator, sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCapacity),
+	                    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+	                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
+	UTILS::createBuffer(device, allocator, sizeof(GpuMeshlet) * static_cast<VkDeviceSize>(meshletCapacity),
+	                    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &meshletBuffer, &meshletBufferMemory);
+
+	// Everything starts free
+	for (auto& stream : vertexStreams) {
+		stream.freeRanges[0] = vertexCapacity;
+	}
+	freeIndexRanges[0] = indexCapacity * getIndexSlots(VK_INDEX_TYPE_UINT32);
+	freeMeshletRanges[0] = meshletCapacity;
+}
+
+uint32_t GeometryArena::allocateVertices(uint32_t count, VertexFormat format) {
+	std::lock_guard<std::mutex> lock(rangeMutex);
+	if (vertexStreams[static_cast<size_t>(format)].buffer == VK_NULL_HANDLE) {
+		createVertexStream(format);
+	}
+
+	uint32_t first;
+	if (!allocateRange(vertexStreams[static_cast<size_t>(format)].freeRanges, count, 1, &first)) {
+		throw std::runtime_error("Geometry Arena is out of vertex space!");
+	}
+	return first;
+}
+
+uint32_t GeometryArena::allocateIndices(uint32_t count, VkIndexType indexType) {
+	// Element i of a type starts at slot i * slots, so ranges must start on a multiple of it
+	uint32_t slots = getIndexSlots(indexType);
+
+	std::lock_guard<std::mutex> lock(rangeMutex);
+	uint32_t first;
+	if (!allocateRange(freeIndexRanges, count * slots, slots, &first)) {
+		throw std::runtime_error("Geometry Arena is out of index space!");
+	}
+	return first / slots;
+}
+
+uint32_t GeometryArena::allocateMeshlets(uint32_t count) {
+	std::lock_guard<std::mutex> lock(rangeMutex);
+	uint32_t first;
+	if (!allocateRange(freeMeshletRanges, count, 1, &first)) {
+		throw std::runtime_error("Geometry Arena is out of meshlet space!");
+	}
+	return first;
+}
+
+void GeometryArena::freeVertices(uint32_t first, uint32_t count, VertexFormat format) {
+	std::lock_guard<std::mutex> lock(rangeMutex);
+	freeRange(vertexStreams[static_cast<size_t>(format)].freeRanges, first, count);
+}
+
+void GeometryArena::freeIndices(uint32_t first, uint32_t count, VkIndexType indexType) {
+	uint32_t slots = getIndexSlots(indexType);
+
+	std::lock_guard<std::mutex> lock(rangeMutex);
+	freeRange(freeIndexRanges, first * slots, count * slots);
+}
+
+void GeometryArena::freeMeshlets(uint32_t first, uint32_t count) {
+	std::lock_guard<std::mutex> lock(rangeMutex);
+	freeRange(freeMeshletRanges, first, count);
+}
+
+VkBuffer GeometryArena::getVertexBuffer(VertexFormat format) {
+	return vertexStreams[static_cast<size_t>(format)].buffer;
+}
+
+VkBuffer GeometryArena::getIndexBuffer() {
+	return indexBuffer;
+}
+
+VkBuffer GeometryArena::getMeshletBuffer() {
+	return meshletBuffer;
+}
+
+void GeometryArena::destroy() {
+	for (auto& stream : vertexStreams) {
+		vkDestroyBuffer(device, stream.buffer, nullptr);
+		allocator->free(stream.memory);
+	}
+	vkDestroyBuffer(device, indexBuffer, nullptr);
+	allocator->free(indexBufferMemory);
+	vkDestroyBuffer(device, meshletBuffer, nullptr);
+	allocator->free(meshletBufferMemory);
+}
+
+GeometryArena::~GeometryArena() = default;
+
+void GeometryArena::createVertexStream(VertexFormat format) {
+	VertexStream& stream = vertexStreams[static_cast<size_t>(format)];
+	VkDeviceSize vertexSize = format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+	UTILS::createBuffer(device, allocator, vertexSize * static_cast<VkDeviceSize>(vertexCapacity),
+	                    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+	                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &stream.buffer, &stream.memory);
+}
+
+bool GeometryArena::allocateRange(std::map<uint32_t, uint32_t>& freeRanges, uint32_t count, uint32_t alignment, uint32_t* first) {
+	// First fit, start rounded up to alignment (the skipped gap stays free)
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+		uint32_t rangeFirst = it->first;
+		uint32_t rangeEnd = it->first + it->second;
+		uint32_t alignedFirst = (rangeFirst + alignment - 1) / alignment * alignment;
+		if (alignedFirst > rangeEnd || rangeEnd - alignedFirst < count) {
+			continue;
+		}
+
+		freeRanges.erase(it);
+		if (alignedFirst > rangeFirst) {
+			freeRanges[rangeFirst] = alignedFirst - rangeFirst;
+		}
+		if (rangeEnd > alignedFirst + count) {
+			freeRanges[alignedFirst + count] = rangeEnd - (alignedFirst + count);
+		}
+
+		*first = alignedFirst;
+		return true;
+	}
+
+	return false;
+}
+
+uint32_t GeometryArena::getIndexSlots(VkIndexType indexType) {
+	return indexType == VK_INDEX_TYPE_UINT16 ? 1 : 2;
+}
+
+void GeometryArena::freeRange(std::map<uint32_t, uint32_t>& freeRanges, uint32_t first, uint32_t count) {
+	if (count == 0) {
+		return;
+	}
+
+	// Merge with free neighbours
+	auto next = freeRanges.lower_bound(first);
+	if (next != freeRanges.end() && first + count == next->first) {
+		count += next->second;
+		next = freeRanges.erase(next);
+	}
+	if (next != freeRanges.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == first) {
+			first = prev->first;
+			count += prev->second;
+			freeRanges.erase(prev);
+		}
+	}
+	freeRanges[first] = count;
+}
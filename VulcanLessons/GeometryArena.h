@@ -0,0 +1,70 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <map>
+#include <mutex>
+
+#include "MemoryAllocator.h"
+#include "Mesh.h"
+
+// Device local vertex buffers (one per VertexFormat, created on first use), one index buffer and one meshlet (storage) buffer shared by every Mesh.
+// Meshes only own a range of vertices, indices and meshlets inside them, so buffers are bound once per frame.
+// The index buffer holds both uint16 and uint32 indices (same buffer bound with either type).
+// Ranges can be allocated and freed from several threads.
+class GeometryArena {
+public:
+	GeometryArena(MemoryAllocator* newAllocator, VkDevice newDevice, uint32_t newVertexCapacity, uint32_t newIndexCapacity,
+		uint32_t newMeshletCapacity);
+
+	// Reserve room for count elements and return the first element index
+	// (for indices counted in elements of indexType, as used by firstIndex when the buffer is bound with that type)
+	uint32_t allocateVertices(uint32_t count, VertexFormat format);
+	uint32_t allocateIndices(uint32_t count, VkIndexType indexType);
+	uint32_t allocateMeshlets(uint32_t count);
+
+	// Return ranges given out by allocateVertices/allocateIndices/allocateMeshlets
+	void freeVertices(uint32_t first, uint32_t count, VertexFormat format);
+	void freeIndices(uint32_t first, uint32_t count, VkIndexType indexType);
+	void freeMeshlets(uint32_t first, uint32_t count);
+
+	VkBuffer getVertexBuffer(VertexFormat format);
+	VkBuffer getIndexBuffer();
+	VkBuffer getMeshletBuffer();		// GpuMeshlet array
+
+	void destroy();
+
+	~GeometryArena();
+
+private:
+	MemoryAllocator* allocator;
+	VkDevice device;
+
+	struct VertexStream {
+		VkBuffer buffer = VK_NULL_HANDLE;			// Created by the first allocation of its format (Full up front)
+		MemoryAllocation memory;
+		std::map<uint32_t, uint32_t> freeRanges;	// First element -> element count
+	};
+
+	uint32_t vertexCapacity;						// Per format
+	std::array<VertexStream, VERTEX_FORMAT_COUNT> vertexStreams;
+
+	uint32_t indexCapacity;							// In uint32 indices
+	VkBuffer indexBuffer;
+	MemoryAllocation indexBufferMemory;
+	std::map<uint32_t, uint32_t> freeIndexRanges;	// Same layout as VertexStream::freeRanges, counted in uint16 slots, uint32 indices take 2 (aligned)
+
+	uint32_t meshletCapacity;
+	VkBuffer meshletBuffer;
+	MemoryAllocation meshletBufferMemory;
+	std::map<uint32_t, uint32_t> freeMeshletRanges;
+
+	std::mutex rangeMutex;
+
+	void createVertexStream(VertexFormat format);
+	static bool allocateRange(std::map<uint32_t, uint32_t>& freeRanges, uint32_t count, uint32_t alignment, uint32_t* first);
+	static uint32_t getIndexSlots(VkIndexType indexType);
+	static void freeRange(std::map<uint32_t, uint32_t>& freeRanges, uint32_t first, uint32_t count);
+};
@@ -0,0 +1,260 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+MemoryAllocator::MemoryAllocator(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkDeviceSize newBlockSize) {
+	physicalDevice = newPhysicalDevice;
+	device = newDevice;
+	blockSize = newBlockSize;
+
+	// Memory types and granularity are fixed for the device, so only query them once
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	bufferImageGranularity = std::max<VkDeviceSize>(deviceProperties.limits.bufferImageGranularity, 1);
+
+	pools.resize(memoryProperties.memoryTypeCount);
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear) {
+	uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+
+	VkDeviceSize size = requirements.size;
+	VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+
+	// Linear and optimal resources must not share a bufferImageGranularity "page".
+	// Giving optimal images whole pages means no page can ever hold both kinds.
+	if (!linear && bufferImageGranularity > 1) {
+		alignment = alignUp(alignment, bufferImageGranularity);
+		size = alignUp(size, bufferImageGranularity);
+	}
+
+	std::lock_guard<std::mutex> lock(poolMutex);
+	std::vector<Block>& pool = pools[memoryTypeIndex];
+
+	MemoryAllocation allocation = {};
+	allocation.memoryTypeIndex = memoryTypeIndex;
+	allocation.size = size;
+
+	// Try to fit in an existing block first
+	bool found = false;
+	for (uint32_t i = 0; i < pool.size() && !found; i++) {
+		if (pool[i].memory == VK_NULL_HANDLE || pool[i].dedicated) {
+			continue;
+		}
+
+		if (allocateFromBlock(pool[i], size, alignment, &allocation.offset)) {
+			allocation.blockIndex = i;
+			found = true;
+		}
+	}
+
+	// No room (or no blocks yet), so get a new block from the driver
+	if (!found) {
+		bool dedicated = size > blockSize;
+		allocation.blockIndex = createBlock(memoryTypeIndex, dedicated ? size : blockSize, dedicated);
+
+		if (!allocateFromBlock(pool[allocation.blockIndex], size, alignment, &allocation.offset)) {
+			throw std::runtime_error("Failed to sub-allocate from a new Memory Block!");
+		}
+	}
+
+	Block& block = pool[allocation.blockIndex];
+	allocation.memory = block.memory;
+	if (block.mapped) {
+		allocation.mapped = static_cast<char*>(block.mapped) + allocation.offset;
+	}
+
+	return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation& allocation) {
+	if (allocation.memory == VK_NULL_HANDLE) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(poolMutex);
+	std::vector<Block>& pool = pools[allocation.memoryTypeIndex];
+	Block& block = pool[allocation.blockIndex];
+
+	// Return range to block, merging with free neighbours so large ranges can be reused
+	VkDeviceSize offset = allocation.offset;
+	VkDeviceSize size = allocation.size;
+
+	auto next = block.freeRanges.lower_bound(offset);
+	if (next != block.freeRanges.end() && offset + size == next->first) {
+		size += next->second;
+		next = block.freeRanges.erase(next);
+	}
+	if (next != block.freeRanges.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			block.freeRanges.erase(prev);
+		}
+	}
+	block.freeRanges[offset] = size;
+	block.allocationCount--;
+
+	// Give empty blocks back to the driver, but keep one spare regular block per memory type to avoid thrashing
+	if (block.allocationCount == 0) {
+		bool spareExists = false;
+		for (uint32_t i = 0; i < pool.size(); i++) {
+			if (i != allocation.blockIndex && pool[i].memory != VK_NULL_HANDLE && !pool[i].dedicated && pool[i].allocationCount == 0) {
+				spareExists = true;
+				break;
+			}
+		}
+
+		if (block.dedicated || spareExists) {
+			releaseBlock(block);
+		}
+	}
+
+	allocation = {};
+}
+
+MemoryStats MemoryAllocator::getStats() {
+	std::lock_guard<std::mutex> lock(poolMutex);
+	MemoryStats stats = {};
+	VkDeviceSize freeBytes = 0;
+
+	for (auto& pool : pools) {
+		for (auto& block : pool) {
+			if (block.memory == VK_NULL_HANDLE) {
+				continue;
+			}
+
+			stats.blockCount++;
+			stats.allocationCount += block.allocationCount;
+			stats.blockBytes += block.size;
+
+			VkDeviceSize blockFree = 0;
+			for (auto& range : block.freeRanges) {
+				blockFree += range.second;
+				stats.largestFreeRange = std::max(stats.largestFreeRange, range.second);
+			}
+			freeBytes += blockFree;
+			stats.usedBytes += block.size - blockFree;
+		}
+	}
+
+	if (freeBytes > 0) {
+		stats.fragmentation = 1.0f - static_cast<float>(stats.largestFreeRange) / static_cast<float>(freeBytes);
+	}
+
+	return stats;
+}
+
+void MemoryAllocator::destroy() {
+	std::lock_guard<std::mutex> lock(poolMutex);
+	for (auto& pool : pools) {
+		for (auto& block : pool) {
+			releaseBlock(block);
+		}
+		pool.clear();
+	}
+}
+
+MemoryAllocator::~MemoryAllocator() = default;
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t allowedTypes, VkMemoryPropertyFlags properties) {
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((allowedTypes & (1 << i))
+			&& (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find a suitable memory type!");
+}
+
+uint32_t MemoryAllocator::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated) {
+	Block block;
+	block.size = size;
+	block.dedicated = dedicated;
+	block.freeRanges[0] = size;
+
+	VkMemoryAllocateInfo memoryAllocInfo = {};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.allocationSize = size;
+	memoryAllocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkResult result = vkAllocateMemory(device, &memoryAllocInfo, nullptr, &block.memory);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate a Memory Block!");
+	}
+
+	// Host visible blocks stay mapped for their whole life (a VkDeviceMemory can only be mapped once at a time)
+	if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		result = vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to map a Memory Block!");
+		}
+	}
+
+	// Reuse a released slot so blockIndex of live allocations stays valid
+	std::vector<Block>& pool = pools[memoryTypeIndex];
+	for (uint32_t i = 0; i < pool.size(); i++) {
+		if (pool[i].memory == VK_NULL_HANDLE) {
+			pool[i] = block;
+			return i;
+		}
+	}
+
+	pool.push_back(block);
+	return static_cast<uint32_t>(pool.size() - 1);
+}
+
+bool MemoryAllocator::allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset) {
+	// First fit: take first free range that can hold the size after aligning its start
+	for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+		VkDeviceSize rangeOffset = it->first;
+		VkDeviceSize rangeSize = it->second;
+		VkDeviceSize alignedOffset = alignUp(rangeOffset, alignment);
+
+		if (alignedOffset + size > rangeOffset + rangeSize) {
+			continue;
+		}
+
+		block.freeRanges.erase(it);
+
+		// Padding in front of aligned start stays free
+		if (alignedOffset > rangeOffset) {
+			block.freeRanges[rangeOffset] = alignedOffset - rangeOffset;
+		}
+
+		// Remainder after allocation stays free
+		VkDeviceSize end = alignedOffset + size;
+		if (end < rangeOffset + rangeSize) {
+			block.freeRanges[end] = rangeOffset + rangeSize - end;
+		}
+
+		block.allocationCount++;
+		*offset = alignedOffset;
+		return true;
+	}
+
+	return false;
+}
+
+void MemoryAllocator::releaseBlock(Block& block) {
+	if (block.memory == VK_NULL_HANDLE) {
+		return;
+	}
+
+	if (block.mapped) {
+		vkUnmapMemory(device, block.memory);
+	}
+	vkFreeMemory(device, block.memory, nullptr);
+
+	block = Block();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Size of each VkDeviceMemory block requested from the driver (bigger resources get a dedicated block)
+const VkDeviceSize MEMORY_BLOCK_SIZE = 64 * 1024 * 1024;
+
+// A region of device memory carved out of a larger block
+struct MemoryAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;	// Block the region lives in (bind resources with this + offset)
+	VkDeviceSize offset = 0;				// Offset of region inside block
+	VkDeviceSize size = 0;					// Size of region reserved inside block
+	void* mapped = nullptr;					// Host pointer to start of region (only for HOST_VISIBLE memory, otherwise nullptr)
+	uint32_t memoryTypeIndex = 0;			// Memory type the block was allocated from
+	uint32_t blockIndex = 0;				// Block inside the memory type pool
+};
+
+// Current state of all pools
+struct MemoryStats {
+	size_t blockCount = 0;					// Number of live vkAllocateMemory blocks
+	size_t allocationCount = 0;				// Number of regions handed out
+	VkDeviceSize blockBytes = 0;			// Bytes reserved from the driver
+	VkDeviceSize usedBytes = 0;				// Bytes handed out to resources
+	VkDeviceSize largestFreeRange = 0;		// Biggest contiguous free region across all blocks
+	float fragmentation = 0.0f;				// 1 - largestFreeRange / free bytes (0 = all free space is one range)
+};
+
+// Safe to use from several threads (model loading allocates from worker threads)
+class MemoryAllocator {
+public:
+	MemoryAllocator(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkDeviceSize newBlockSize = MEMORY_BLOCK_SIZE);
+
+	// linear = buffer or linear image, false = optimal tiling image (needed to respect bufferImageGranularity)
+	MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear);
+	void free(MemoryAllocation& allocation);
+
+	MemoryStats getStats();
+
+	void destroy();
+
+	~MemoryAllocator();
+
+private:
+	struct Block {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges;	// Offset -> size of each free range, sorted so neighbours can be merged
+		size_t allocationCount = 0;
+		bool dedicated = false;								// Block was sized for a single oversized resource
+	};
+
+	VkPhysicalDevice physicalDevice;
+	VkDevice device;
+	VkDeviceSize blockSize;
+	VkDeviceSize bufferImageGranularity;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+
+	// One list of blocks for each memory type
+	std::vector<std::vector<Block>> pools;
+	std::mutex poolMutex;
+
+	uint32_t findMemoryType(uint32_t allowedTypes, VkMemoryPropertyFlags properties);
+	uint32_t createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated);
+	bool allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset);
+	void releaseBlock(Block& block);
+};
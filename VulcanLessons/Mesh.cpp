@@ -1,22 +1,89 @@
 #include "Mesh.h"
 
+#include <algorithm>
 #include <stdexcept>
 
-#include "Utils.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "GeometryArena.h"
+#include "UploadBatch.h"
 
 Mesh::Mesh() = default;
 
-Mesh::Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, 
-	VkQueue transferQueue, VkCommandPool transferCommandPool, 
-	std::vector<Vertex>* vertices, std::vector<uint32_t> * indices, int tid)
+Mesh::Mesh(GeometryArena* newArena, UploadBatch* uploadBatch, VkDevice newDevice,
+	const Vertex* vertices, uint32_t newVertexCount, const uint32_t* indices, uint32_t newIndexCount, int tid,
+	VertexFormat newVertexFormat, const MeshLod* newLods, uint32_t newLodCount, const Meshlet* newMeshlets, uint32_t newMeshletCount)
 {
-	vertexCount = vertices->size();
-	indexCount = indices->size();
-	physicalDevice = newPhysicalDevice;
+	vertexCount = newVertexCount;
+	vertexFormat = newVertexFormat;
+	dequantize = glm::mat4(1.0f);
+	indexCount = newIndexCount;
+	meshletCount = newMeshletCount;
+	arena = newArena;
 	device = newDevice;
 	texId = tid;
-	createVertexBuffer(transferQueue, transferCommandPool, vertices);
-	createIndexBuffer(transferQueue, transferCommandPool, indices);
+
+	// No levels given = all indices are one full detail level
+	if (newLods && newLodCount > 0) {
+		lods.assign(newLods, newLods + newLodCount);
+	}
+	else {
+		lods.assign(1, MeshLod{ 0, newIndexCount, 0.0f });
+	}
+
+	// Box of all vertices, and the bounding sphere around it
+	boundsCenter = glm::vec3(0.0f);
+	boundsRadius = 0.0f;
+	boundsMin = glm::vec3(0.0f);
+	boundsMax = glm::vec3(0.0f);
+	if (vertexCount > 0) {
+		boundsMin = vertices[0].pos;
+		boundsMax = vertices[0].pos;
+		for (int i = 1; i < vertexCount; i++) {
+			boundsMin = glm::min(boundsMin, vertices[i].pos);
+			boundsMax = glm::max(boundsMax, vertices[i].pos);
+		}
+		boundsCenter = (boundsMin + boundsMax) * 0.5f;
+		for (int i = 0; i < vertexCount; i++) {
+			boundsRadius = std::max(boundsRadius, glm::length(vertices[i].pos - boundsCenter));
+		}
+	}
+
+	// Indices stay relative to the mesh (vertexOffset is applied at draw time), so uint16 is enough for up to 65536 vertices
+	indexType = vertexCount <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	if (!newMeshlets) {
+		meshletCount = 0;
+	}
+
+	// Reserve all ranges in the shared arena buffers up front, giving back the ones already taken if a later one
+	// doesn't fit (mesh is never handed out, so nothing else would free them)
+	firstVertex = arena->allocateVertices(vertexCount, vertexFormat);
+	try {
+		firstIndex = arena->allocateIndices(indexCount, indexType);
+		try {
+			firstMeshlet = meshletCount > 0 ? arena->allocateMeshlets(meshletCount) : 0;
+		}
+		catch (...) {
+			arena->freeIndices(firstIndex, indexCount, indexType);
+			throw;
+		}
+	}
+	catch (...) {
+		arena->freeVertices(firstVertex, vertexCount, vertexFormat);
+		throw;
+	}
+
+	// Staging can still fail (out of host memory)
+	try {
+		createVertexBuffer(uploadBatch, vertices);
+		createIndexBuffer(uploadBatch, indices);
+		createMeshletBuffer(uploadBatch, newMeshlets);
+	}
+	catch (...) {
+		destroyBuffers();
+		throw;
+	}
 
 	model = glm::mat4(1.0f);
 }
@@ -25,6 +92,10 @@ int Mesh::getTexId() {
 	return texId;
 }
 
+void Mesh::setTexId(int newTexId) {
+	texId = newTexId;
+}
+
 
 void Mesh::setModel(glm::mat4 newModel) {
 	model = newModel;
@@ -39,9 +110,19 @@ int Mesh::getVertexCount()
 	return vertexCount;
 }
 
-VkBuffer Mesh::getVertexBuffer()
+int32_t Mesh::getVertexOffset()
+{
+	return static_cast<int32_t>(firstVertex);
+}
+
+VertexFormat Mesh::getVertexFormat()
+{
+	return vertexFormat;
+}
+
+glm::mat4 Mesh::getDequantize()
 {
-	return vertexBuffer;
+	return dequantize;
 }
 
 int Mesh::getIndexCount()
@@ -49,80 +130,147 @@ int Mesh::getIndexCount()
 	return indexCount;
 }
 
-VkBuffer Mesh::getIndexBuffer()
+uint32_t Mesh::getFirstIndex()
 {
-	return indexBuffer;
+	return firstIndex;
 }
 
-void Mesh::destroyBuffers()
+VkIndexType Mesh::getIndexType()
 {
-	vkDestroyBuffer(device, vertexBuffer, nullptr);
-	vkFreeMemory(device, vertexBufferMemory, nullptr);
-	vkDestroyBuffer(device, indexBuffer, nullptr);
-	vkFreeMemory(device, indexBufferMemory, nullptr);
+	return indexType;
 }
 
+size_t Mesh::getLodCount()
+{
+	return lods.size();
+}
 
-Mesh::~Mesh() = default;
+const MeshLod& Mesh::getLod(size_t level)
+{
+	return lods[level];
+}
 
-void Mesh::createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices)
+size_t Mesh::getLodForError(float maxError)
 {
-	// Get size of buffer needed for vertices
-	VkDeviceSize bufferSize = sizeof(Vertex) * vertices->size();
+	// Levels get coarser (larger error) with their number
+	size_t level = 0;
+	while (level + 1 < lods.size() && lods[level + 1].error <= maxError) {
+		level++;
+	}
+	return level;
+}
 
-	// Temporary buffer to "stage" vertex data before transferring to GPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+uint32_t Mesh::getFirstMeshlet()
+{
+	return firstMeshlet;
+}
 
-	// Create Staging Buffer and Allocate Memory to it
-	UTILS::createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-	                    &stagingBuffer, &stagingBufferMemory);
+uint32_t Mesh::getMeshletCount()
+{
+	return meshletCount;
+}
 
-	// MAP MEMORY TO VERTEX BUFFER
-	void * data;																// 1. Create pointer to a point in normal memory
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);			// 2. "Map" the vertex buffer memory to that point
-	memcpy(data, vertices->data(), (size_t)bufferSize);							// 3. Copy memory from vertices vector to the point
-	vkUnmapMemory(device, stagingBufferMemory);									// 4. Unmap the vertex buffer memory
+glm::vec3 Mesh::getBoundsCenter()
+{
+	return boundsCenter;
+}
 
-	// Create buffer with TRANSFER_DST_BIT to mark as recipient of transfer data (also VERTEX_BUFFER)
-	// Buffer memory is to be DEVICE_LOCAL_BIT meaning memory is on the GPU and only accessible by it and not CPU (host)
-	UTILS::createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-	                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertexBuffer, &vertexBufferMemory);
+float Mesh::getBoundsRadius()
+{
+	return boundsRadius;
+}
 
-	// Copy staging buffer to vertex buffer on GPU
-	UTILS::copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, vertexBuffer, bufferSize);
+glm::vec3 Mesh::getBoundsMin()
+{
+	return boundsMin;
+}
 
-	// Clean up staging buffer parts
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+glm::vec3 Mesh::getBoundsMax()
+{
+	return boundsMax;
 }
 
-void Mesh::createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices)
+void Mesh::destroyBuffers()
 {
-	// Get size of buffer needed for indices
-	VkDeviceSize bufferSize = sizeof(uint32_t) * indices->size();
-	
-	// Temporary buffer to "stage" index data before transferring to GPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	UTILS::createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+	// Give ranges back to the arena, buffers themselves are owned by it
+	arena->freeVertices(firstVertex, vertexCount, vertexFormat);
+	arena->freeIndices(firstIndex, indexCount, indexType);
+	arena->freeMeshlets(firstMeshlet, meshletCount);
+}
+
 
-	// MAP MEMORY TO INDEX BUFFER
-	void * data;																
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);			
-	memcpy(data, indices->data(), (size_t)bufferSize);							
-	vkUnmapMemory(device, stagingBufferMemory);
+Mesh::~Mesh() = default;
 
-	// Create buffer for INDEX data on GPU access only area
-	UTILS::createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-	                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
+void Mesh::createVertexBuffer(UploadBatch* uploadBatch, const Vertex* vertices)
+{
+	// Range in the shared DEVICE_LOCAL vertex buffer of this format was reserved by the constructor
+	if (vertexFormat == VertexFormat::Full) {
+		// Stage vertex data, the copy to the GPU happens when the batch is submitted
+		uploadBatch->uploadBuffer(arena->getVertexBuffer(vertexFormat), sizeof(Vertex) * static_cast<VkDeviceSize>(firstVertex),
+		                          vertices, sizeof(Vertex) * static_cast<VkDeviceSize>(vertexCount));
+		return;
+	}
+
+	// COMPACT VERTICES
+	// Positions are stored as 0..1 inside the mesh bounds (box computed in the constructor)
+	glm::vec3 extent = boundsMax - boundsMin;
+	for (int axis = 0; axis < 3; axis++) {
+		// Flat axis, every vertex quantizes to 0 anyway
+		if (extent[axis] <= 0.0f) {
+			extent[axis] = 1.0f;
+		}
+	}
+
+	std::vector<CompactVertex> compactVertices(vertexCount);
+	for (int i = 0; i < vertexCount; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			float normalised = (vertices[i].pos[axis] - boundsMin[axis]) / extent[axis];
+			compactVertices[i].pos[axis] = static_cast<uint16_t>(normalised * 65535.0f + 0.5f);
+		}
+		compactVertices[i].pos[3] = 0;
+		compactVertices[i].tex[0] = glm::packHalf1x16(vertices[i].tex.x);
+		compactVertices[i].tex[1] = glm::packHalf1x16(vertices[i].tex.y);
+	}
+
+	// UNORM attribute reads back 0..1, scale and move it back into the bounds
+	dequantize = glm::scale(glm::translate(glm::mat4(1.0f), boundsMin), extent);
+
+	// Batch copies the data, so the compact list can be temporary
+	uploadBatch->uploadBuffer(arena->getVertexBuffer(vertexFormat), sizeof(CompactVertex) * static_cast<VkDeviceSize>(firstVertex),
+	                          compactVertices.data(), sizeof(CompactVertex) * static_cast<VkDeviceSize>(vertexCount));
+}
+
+void Mesh::createIndexBuffer(UploadBatch* uploadBatch, const uint32_t* indices)
+{
+	// Stage index data into the same batch (batch copies the data, so the narrowed list can be temporary)
+	if (indexType == VK_INDEX_TYPE_UINT16) {
+		std::vector<uint16_t> shortIndices(indices, indices + indexCount);
+		uploadBatch->uploadBuffer(arena->getIndexBuffer(), sizeof(uint16_t) * static_cast<VkDeviceSize>(firstIndex),
+		                          shortIndices.data(), sizeof(uint16_t) * static_cast<VkDeviceSize>(indexCount));
+	}
+	else {
+		uploadBatch->uploadBuffer(arena->getIndexBuffer(), sizeof(uint32_t) * static_cast<VkDeviceSize>(firstIndex),
+		                          indices, sizeof(uint32_t) * static_cast<VkDeviceSize>(indexCount));
+	}
+}
+
+void Mesh::createMeshletBuffer(UploadBatch* uploadBatch, const Meshlet* meshlets)
+{
+	if (meshletCount == 0) {
+		return;
+	}
 
-	// Copy from staging buffer to GPU access buffer
-	UTILS::copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, indexBuffer, bufferSize);
+	// Cull shader writes draws straight from these, so index ranges go in as arena positions
+	std::vector<GpuMeshlet> gpuMeshlets(meshletCount);
+	for (uint32_t i = 0; i < meshletCount; i++) {
+		gpuMeshlets[i].sphere = glm::vec4(meshlets[i].center, meshlets[i].radius);
+		gpuMeshlets[i].cone = glm::vec4(meshlets[i].coneAxis, meshlets[i].coneCutoff);
+		gpuMeshlets[i].firstIndex = firstIndex + meshlets[i].firstIndex;
+		gpuMeshlets[i].indexCount = meshlets[i].indexCount;
+		gpuMeshlets[i].vertexOffset = static_cast<int32_t>(firstVertex);
+		gpuMeshlets[i].padding = 0;
+	}
 
-	// Destroy + Release Staging Buffer resources
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	uploadBatch->uploadBuffer(arena->getMeshletBuffer(), sizeof(GpuMeshlet) * static_cast<VkDeviceSize>(firstMeshlet),
+	                          gpuMeshlets.data(), sizeof(GpuMeshlet) * static_cast<VkDeviceSize>(meshletCount));
 }
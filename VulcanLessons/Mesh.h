@@ -7,6 +7,9 @@
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 
+class GeometryArena;
+class UploadBatch;
+
 
 struct Vertex {
 	glm::vec3 pos; // Vertex Position (x, y, z)
@@ -14,24 +17,85 @@ struct Vertex {
 	glm::vec2 tex; // Texture Coords (u, v)
 };
 
+// Quantized vertex, 12 bytes instead of 32. Colour is dropped (always white)
+struct CompactVertex {
+	uint16_t pos[4];	// Position as UNORM16 inside the mesh bounds (x, y, z, unused padding)
+	uint16_t tex[2];	// Texture Coords as half floats (u, v)
+};
+
+// Index range of one detail level, all levels of a mesh share its vertices
+struct MeshLod {
+	uint32_t firstIndex;	// Relative to the mesh's first index
+	uint32_t indexCount;
+	float error;			// Largest distance from the full detail surface, in model space (0 = full detail)
+};
+
+// Run of a mesh's full detail triangles culled on its own (bounds in model space)
+struct Meshlet {
+	uint32_t firstIndex;	// Relative to the mesh's first index
+	uint32_t indexCount;
+	glm::vec3 center;		// Bounding sphere
+	float radius;
+	glm::vec3 coneAxis;		// Every face normal is within the cone, so the meshlet faces away from cameras behind it
+	float coneCutoff;		// 1 = never back facing
+};
+
+// Meshlet as the cull shader reads it (std430, see Shaders/cull.comp), index range already placed in the arena
+struct GpuMeshlet {
+	glm::vec4 sphere;		// Center, radius
+	glm::vec4 cone;			// Axis, cutoff
+	uint32_t firstIndex;	// In elements of the mesh's index type
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	uint32_t padding;
+};
+
+// Vertex layout a mesh is stored with, each has its own arena buffer and pipeline
+enum class VertexFormat {
+	Full,				// Vertex
+	Compact				// CompactVertex, positions go back to model space through getDequantize()
+};
+const size_t VERTEX_FORMAT_COUNT = 2;
+
 class Mesh {
 public:
 	Mesh();
-	Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, 
-		VkQueue transferQueue, VkCommandPool transferCommandPool, 
-		std::vector<Vertex> * vertices, std::vector<uint32_t> * indices,
-		int tid);
+	Mesh(GeometryArena* newArena, UploadBatch* uploadBatch, VkDevice newDevice,
+		const Vertex* vertices, uint32_t newVertexCount, const uint32_t* indices, uint32_t newIndexCount,
+		int tid, VertexFormat newVertexFormat = VertexFormat::Full, const MeshLod* newLods = nullptr, uint32_t newLodCount = 0,
+		const Meshlet* newMeshlets = nullptr, uint32_t newMeshletCount = 0);
 
 	void setModel(glm::mat4 newModel);
 	glm::mat4 getModel();
 
 	int getTexId();
+	void setTexId(int newTexId);
 	
 	int getVertexCount();
-	VkBuffer getVertexBuffer();
+	int32_t getVertexOffset();
+	VertexFormat getVertexFormat();
+	// Matrix from stored positions to model space (identity for Full vertices), goes before the model matrix
+	glm::mat4 getDequantize();
 
 	int getIndexCount();
-	VkBuffer getIndexBuffer();
+	uint32_t getFirstIndex();
+	VkIndexType getIndexType();
+
+	size_t getLodCount();
+	const MeshLod& getLod(size_t level);
+	// Coarsest level whose error is at most maxError (model space)
+	size_t getLodForError(float maxError);
+
+	// Range of the mesh's meshlets in the arena meshlet buffer (count 0 = no meshlets)
+	uint32_t getFirstMeshlet();
+	uint32_t getMeshletCount();
+
+	// Bounding sphere in model space
+	glm::vec3 getBoundsCenter();
+	float getBoundsRadius();
+	// Bounding box in model space
+	glm::vec3 getBoundsMin();
+	glm::vec3 getBoundsMax();
 
 	void destroyBuffers();
 
@@ -41,18 +105,30 @@ private:
 	glm::mat4 model;
 	int texId;
 	
+	// Location of mesh data inside the shared geometry arena buffers
 	int vertexCount;
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
+	uint32_t firstVertex;				// In vertices of vertexFormat
+	VertexFormat vertexFormat;
+	glm::mat4 dequantize;
 
 	int indexCount;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
+	uint32_t firstIndex;				// In elements of indexType
+	VkIndexType indexType;				// UINT16 whenever every vertex can be addressed with it
+	std::vector<MeshLod> lods;			// Ranges inside the mesh's indices, level 0 = full detail
+
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
 
-	VkPhysicalDevice physicalDevice;
+	GeometryArena* arena;
 	VkDevice device;
 
-	void createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex> * vertices);
-	void createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t> * indices);
+	void createVertexBuffer(UploadBatch* uploadBatch, const Vertex* vertices);
+	void createIndexBuffer(UploadBatch* uploadBatch, const uint32_t* indices);
+	void createMeshletBuffer(UploadBatch* uploadBatch, const Meshlet* meshlets);
 };
 
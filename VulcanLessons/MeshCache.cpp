@@ -0,0 +1,416 @@
+// Platform headers first, windows.h must not come after GLFW
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "MeshCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+// FILE LAYOUT
+// CacheHeader
+// strings: source path, then texture files (each '\0' terminated)
+// CacheMeshEntry table (8 byte aligned)
+// node parents, then node local transforms (16 byte aligned)
+// vertex/index/LOD/meshlet arrays (16 byte aligned)
+
+static const char MESH_CACHE_MAGIC[4] = {'V', 'L', 'M', 'C'};
+static const uint64_t MESH_CACHE_ALIGNMENT = 16;
+
+struct CacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceTime;		// Source file modification time
+	uint32_t importFlags;		// Assimp flags the data was imported with
+	uint32_t processFlags;		// MESH_PROCESS_ flags applied after import
+	uint32_t vertexSize;		// sizeof(Vertex), catches layout changes that forgot a version bump
+	uint32_t meshCount;
+	uint32_t textureCount;
+	uint32_t nodeCount;
+	uint64_t stringsSize;
+};
+
+struct CacheMeshEntry {
+	uint64_t vertexOffset;		// From start of file
+	uint64_t indexOffset;
+	uint64_t lodOffset;
+	uint64_t meshletOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	int32_t texId;
+	uint32_t lodCount;
+	uint32_t meshletCount;
+	uint32_t node;
+};
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment) {
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+static std::string getCacheFile(const std::string& modelFile) {
+	return modelFile + ".meshcache";
+}
+
+// Modification time of a file, 0 if it doesn't exist
+static uint64_t getFileTime(const std::string& fileName) {
+#ifdef _WIN32
+	struct _stat64 fileStat;
+	if (_stat64(fileName.c_str(), &fileStat) != 0) {
+		return 0;
+	}
+#else
+	struct stat fileStat;
+	if (stat(fileName.c_str(), &fileStat) != 0) {
+		return 0;
+	}
+#endif
+	return static_cast<uint64_t>(fileStat.st_mtime);
+}
+
+MeshCache::MeshCache() = default;
+
+bool MeshCache::open(const std::string& modelFile, uint32_t importFlags, uint32_t processFlags) {
+	close();
+
+	if (!map(getCacheFile(modelFile))) {
+		return false;
+	}
+
+	if (!parse(modelFile, importFlags, processFlags)) {
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MeshCache::close() {
+#ifdef _WIN32
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle) {
+		CloseHandle(fileHandle);
+	}
+#else
+	if (data) {
+		munmap(const_cast<char*>(data), dataSize);
+	}
+#endif
+	data = nullptr;
+	dataSize = 0;
+	fileHandle = nullptr;
+	mappingHandle = nullptr;
+
+	textureFiles.clear();
+	meshes.clear();
+	nodes = NodeHierarchy();
+}
+
+const std::vector<std::string>& MeshCache::getTextureFiles() {
+	return textureFiles;
+}
+
+const std::vector<CachedMesh>& MeshCache::getMeshes() {
+	return meshes;
+}
+
+const NodeHierarchy& MeshCache::getNodes() {
+	return nodes;
+}
+
+void MeshCache::write(const std::string& modelFile, uint32_t importFlags, uint32_t processFlags,
+	const std::vector<std::string>& textureFiles, const std::vector<MeshData>& meshes, const NodeHierarchy& nodes) {
+	CacheHeader header = {};
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.sourceTime = getFileTime(modelFile);
+	header.importFlags = importFlags;
+	header.processFlags = processFlags;
+	header.vertexSize = sizeof(Vertex);
+	header.meshCount = static_cast<uint32_t>(meshes.size());
+	header.textureCount = static_cast<uint32_t>(textureFiles.size());
+	header.nodeCount = static_cast<uint32_t>(nodes.getNodeCount());
+
+	std::string strings = modelFile + '\0';
+	for (auto& textureFile : textureFiles) {
+		strings += textureFile + '\0';
+	}
+	header.stringsSize = strings.size();
+
+	// Work out where every array goes before writing anything
+	uint64_t tableOffset = alignOffset(sizeof(CacheHeader) + strings.size(), 8);
+	uint64_t parentsOffset = alignOffset(tableOffset + sizeof(CacheMeshEntry) * meshes.size(), MESH_CACHE_ALIGNMENT);
+	uint64_t transformsOffset = alignOffset(parentsOffset + sizeof(int32_t) * static_cast<uint64_t>(header.nodeCount), MESH_CACHE_ALIGNMENT);
+	uint64_t offset = transformsOffset + sizeof(glm::mat4) * static_cast<uint64_t>(header.nodeCount);
+
+	std::vector<int32_t> parents(header.nodeCount);
+	std::vector<glm::mat4> localTransforms(header.nodeCount);
+	for (uint32_t i = 0; i < header.nodeCount; i++) {
+		parents[i] = nodes.getParent(i);
+		localTransforms[i] = nodes.getLocalTransform(i);
+	}
+
+	std::vector<CacheMeshEntry> table(meshes.size());
+	std::vector<std::vector<MeshLod>> lods(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		// Meshes without levels are stored with one full detail level
+		lods[i] = meshes[i].lods;
+		if (lods[i].empty()) {
+			lods[i].push_back(MeshLod{ 0, static_cast<uint32_t>(meshes[i].indices.size()), 0.0f });
+		}
+		table[i].lodCount = static_cast<uint32_t>(lods[i].size());
+
+		table[i].vertexCount = static_cast<uint32_t>(meshes[i].vertices.size());
+		table[i].indexCount = static_cast<uint32_t>(meshes[i].indices.size());
+		table[i].texId = meshes[i].texId;
+		table[i].node = meshes[i].node;
+		table[i].meshletCount = static_cast<uint32_t>(meshes[i].meshlets.size());
+
+		table[i].vertexOffset = alignOffset(offset, MESH_CACHE_ALIGNMENT);
+		offset = table[i].vertexOffset + sizeof(Vertex) * meshes[i].vertices.size();
+		table[i].indexOffset = alignOffset(offset, MESH_CACHE_ALIGNMENT);
+		offset = table[i].indexOffset + sizeof(uint32_t) * meshes[i].indices.size();
+		table[i].lodOffset = alignOffset(offset, MESH_CACHE_ALIGNMENT);
+		offset = table[i].lodOffset + sizeof(MeshLod) * lods[i].size();
+		table[i].meshletOffset = alignOffset(offset, MESH_CACHE_ALIGNMENT);
+		offset = table[i].meshletOffset + sizeof(Meshlet) * meshes[i].meshlets.size();
+	}
+
+	// Write to a temporary file first, so a crash never leaves a half written cache behind.
+	// Name is unique per process and thread, as the same model can be converted by several loads at once
+#ifdef _WIN32
+	unsigned long processId = GetCurrentProcessId();
+#else
+	unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+	size_t threadId = std::hash<std::thread::id>()(std::this_thread::get_id());
+	std::string cacheFile = getCacheFile(modelFile);
+	std::string tempFile = cacheFile + "." + std::to_string(processId) + "." + std::to_string(threadId) + ".tmp";
+	{
+		std::ofstream file(tempFile, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			throw std::runtime_error("Failed to create a Mesh Cache file! (" + cacheFile + ")");
+		}
+
+		const char padding[MESH_CACHE_ALIGNMENT] = {};
+		auto padTo = [&](uint64_t target) {
+			uint64_t position = static_cast<uint64_t>(file.tellp());
+			file.write(padding, static_cast<std::streamsize>(target - position));
+		};
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+		padTo(tableOffset);
+		file.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(sizeof(CacheMeshEntry) * table.size()));
+		padTo(parentsOffset);
+		file.write(reinterpret_cast<const char*>(parents.data()), static_cast<std::streamsize>(sizeof(int32_t) * parents.size()));
+		padTo(transformsOffset);
+		file.write(reinterpret_cast<const char*>(localTransforms.data()), static_cast<std::streamsize>(sizeof(glm::mat4) * localTransforms.size()));
+		for (size_t i = 0; i < meshes.size(); i++) {
+			padTo(table[i].vertexOffset);
+			file.write(reinterpret_cast<const char*>(meshes[i].vertices.data()), static_cast<std::streamsize>(sizeof(Vertex) * meshes[i].vertices.size()));
+			padTo(table[i].indexOffset);
+			file.write(reinterpret_cast<const char*>(meshes[i].indices.data()), static_cast<std::streamsize>(sizeof(uint32_t) * meshes[i].indices.size()));
+			padTo(table[i].lodOffset);
+			file.write(reinterpret_cast<const char*>(lods[i].data()), static_cast<std::streamsize>(sizeof(MeshLod) * lods[i].size()));
+			padTo(table[i].meshletOffset);
+			file.write(reinterpret_cast<const char*>(meshes[i].meshlets.data()), static_cast<std::streamsize>(sizeof(Meshlet) * meshes[i].meshlets.size()));
+		}
+
+		if (!file.good()) {
+			file.close();
+			std::remove(tempFile.c_str());
+			throw std::runtime_error("Failed to write a Mesh Cache file! (" + cacheFile + ")");
+		}
+	}
+
+	std::remove(cacheFile.c_str());
+	if (std::rename(tempFile.c_str(), cacheFile.c_str()) != 0) {
+		std::remove(tempFile.c_str());
+		throw std::runtime_error("Failed to write a Mesh Cache file! (" + cacheFile + ")");
+	}
+}
+
+MeshCache::~MeshCache() {
+	close();
+}
+
+bool MeshCache::map(const std::string& cacheFile) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(cacheFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		return false;
+	}
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle) {
+		return false;
+	}
+
+	data = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (!data) {
+		return false;
+	}
+	dataSize = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int file = ::open(cacheFile.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+		::close(file);
+		return false;
+	}
+
+	// Mapping stays valid after the descriptor is closed
+	void* mapped = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+
+	data = static_cast<const char*>(mapped);
+	dataSize = static_cast<size_t>(fileStat.st_size);
+#endif
+	return true;
+}
+
+bool MeshCache::parse(const std::string& modelFile, uint32_t importFlags, uint32_t processFlags) {
+	// Check the cache belongs to this exact source file + import
+	if (dataSize < sizeof(CacheHeader)) {
+		return false;
+	}
+
+	CacheHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != MESH_CACHE_VERSION
+		|| header.vertexSize != sizeof(Vertex)
+		|| header.importFlags != importFlags
+		|| header.processFlags != processFlags
+		|| header.sourceTime != getFileTime(modelFile)) {
+		return false;
+	}
+
+	// Strings block
+	uint64_t stringsEnd = sizeof(CacheHeader) + header.stringsSize;
+	if (stringsEnd > dataSize || header.stringsSize == 0 || data[stringsEnd - 1] != '\0') {
+		return false;
+	}
+
+	const char* string = data + sizeof(CacheHeader);
+	if (modelFile != string) {
+		return false;
+	}
+	string += strlen(string) + 1;
+
+	for (uint32_t i = 0; i < header.textureCount; i++) {
+		if (string >= data + stringsEnd) {
+			return false;
+		}
+		textureFiles.push_back(string);
+		string += strlen(string) + 1;
+	}
+
+	// Mesh table, every array must lie inside the file
+	uint64_t tableOffset = alignOffset(stringsEnd, 8);
+	if (tableOffset + sizeof(CacheMeshEntry) * static_cast<uint64_t>(header.meshCount) > dataSize) {
+		return false;
+	}
+
+	const CacheMeshEntry* table = reinterpret_cast<const CacheMeshEntry*>(data + tableOffset);
+
+	// Node hierarchy, parents must come first (addNode refuses anything else)
+	uint64_t parentsOffset = alignOffset(tableOffset + sizeof(CacheMeshEntry) * static_cast<uint64_t>(header.meshCount), MESH_CACHE_ALIGNMENT);
+	uint64_t transformsOffset = alignOffset(parentsOffset + sizeof(int32_t) * static_cast<uint64_t>(header.nodeCount), MESH_CACHE_ALIGNMENT);
+	if (header.nodeCount == 0 || transformsOffset + sizeof(glm::mat4) * static_cast<uint64_t>(header.nodeCount) > dataSize) {
+		return false;
+	}
+
+	const int32_t* parents = reinterpret_cast<const int32_t*>(data + parentsOffset);
+	const glm::mat4* localTransforms = reinterpret_cast<const glm::mat4*>(data + transformsOffset);
+	try {
+		for (uint32_t i = 0; i < header.nodeCount; i++) {
+			nodes.addNode(parents[i], localTransforms[i]);
+		}
+	}
+	catch (const std::runtime_error&) {
+		return false;
+	}
+	for (uint32_t i = 0; i < header.meshCount; i++) {
+		const CacheMeshEntry& entry = table[i];
+		if (entry.vertexOffset % MESH_CACHE_ALIGNMENT != 0 || entry.indexOffset % MESH_CACHE_ALIGNMENT != 0
+			|| entry.lodOffset % MESH_CACHE_ALIGNMENT != 0 || entry.meshletOffset % MESH_CACHE_ALIGNMENT != 0 || entry.lodCount == 0
+			|| entry.vertexOffset + sizeof(Vertex) * static_cast<uint64_t>(entry.vertexCount) > dataSize
+			|| entry.indexOffset + sizeof(uint32_t) * static_cast<uint64_t>(entry.indexCount) > dataSize
+			|| entry.lodOffset + sizeof(MeshLod) * static_cast<uint64_t>(entry.lodCount) > dataSize
+			|| entry.meshletOffset + sizeof(Meshlet) * static_cast<uint64_t>(entry.meshletCount) > dataSize
+			|| entry.texId >= static_cast<int32_t>(header.textureCount)
+			|| entry.node >= header.nodeCount) {
+			return false;
+		}
+
+		// Indices are used as they are, one past the vertices would read outside the mesh's vertex range
+		const uint32_t* indices = reinterpret_cast<const uint32_t*>(data + entry.indexOffset);
+		for (uint32_t j = 0; j < entry.indexCount; j++) {
+			if (indices[j] >= entry.vertexCount) {
+				return false;
+			}
+		}
+
+		const MeshLod* lods = reinterpret_cast<const MeshLod*>(data + entry.lodOffset);
+		for (uint32_t j = 0; j < entry.lodCount; j++) {
+			if (static_cast<uint64_t>(lods[j].firstIndex) + lods[j].indexCount > entry.indexCount) {
+				return false;
+			}
+		}
+
+		// Meshlets are ranges of the full detail level
+		const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(data + entry.meshletOffset);
+		for (uint32_t j = 0; j < entry.meshletCount; j++) {
+			if (static_cast<uint64_t>(meshlets[j].firstIndex) + meshlets[j].indexCount > lods[0].indexCount) {
+				return false;
+			}
+		}
+
+		CachedMesh mesh;
+		mesh.vertices = reinterpret_cast<const Vertex*>(data + entry.vertexOffset);
+		mesh.vertexCount = entry.vertexCount;
+		mesh.indices = indices;
+		mesh.indexCount = entry.indexCount;
+		mesh.lods = lods;
+		mesh.lodCount = entry.lodCount;
+		mesh.meshlets = meshlets;
+		mesh.meshletCount = entry.meshletCount;
+		mesh.texId = entry.texId;
+		mesh.node = entry.node;
+		meshes.push_back(mesh);
+	}
+
+	return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "MeshModel.h"
+
+// Bump whenever the cache layout or the data it holds changes, old files are then ignored and rewritten
+const uint32_t MESH_CACHE_VERSION = 5;
+
+// Processing done after import that is baked into the cached geometry (part of the cache key)
+const uint32_t MESH_PROCESS_OPTIMIZE = 1 << 0;		// MESH_OPTIMIZER::optimizeMesh
+const uint32_t MESH_PROCESS_LODS = 1 << 1;			// MESH_OPTIMIZER::generateLods
+const uint32_t MESH_PROCESS_MESHLETS = 1 << 2;		// MESH_OPTIMIZER::buildMeshlets
+
+// One mesh inside a mapped cache file (pointers are into the mapping)
+struct CachedMesh {
+	const Vertex* vertices;
+	uint32_t vertexCount;
+	const uint32_t* indices;
+	uint32_t indexCount;
+	const MeshLod* lods;
+	uint32_t lodCount;
+	const Meshlet* meshlets;
+	uint32_t meshletCount;
+	int texId;					// Index into texture files, -1 = default texture
+	uint32_t node;				// Index into the cache's node hierarchy
+};
+
+// Converted geometry of a model stored next to the source file (<model>.meshcache), so repeat loads skip Assimp.
+// Cache is keyed by source path, source modification time, import flags and process flags.
+class MeshCache {
+public:
+	MeshCache();
+
+	// Map cache of modelFile, false if there is none or it is stale/broken
+	bool open(const std::string& modelFile, uint32_t importFlags, uint32_t processFlags);
+	void close();
+
+	const std::vector<std::string>& getTextureFiles();
+	const std::vector<CachedMesh>& getMeshes();
+	const NodeHierarchy& getNodes();
+
+	// Write cache of modelFile (meshes' texIds index into textureFiles, their nodes into nodes)
+	static void write(const std::string& modelFile, uint32_t importFlags, uint32_t processFlags,
+		const std::vector<std::string>& textureFiles, const std::vector<MeshData>& meshes, const NodeHierarchy& nodes);
+
+	~MeshCache();
+
+private:
+	const char* data = nullptr;
+	size_t dataSize = 0;
+	void* fileHandle = nullptr;			// Win32 file and mapping handles (unused elsewhere)
+	void* mappingHandle = nullptr;
+
+	std::vector<std::string> textureFiles;
+	std::vector<CachedMesh> meshes;
+	NodeHierarchy nodes;
+
+	bool map(const std::string& cacheFile);
+	bool parse(const std::string& modelFile, uint32_t importFlags, uint32_t processFlags);
+};
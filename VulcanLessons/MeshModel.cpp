@@ -1,13 +1,60 @@
 #include "MeshModel.h"
 
+#include <algorithm>
 #include <stdexcept>
+#include <utility>
+
+#include "VertexConvert.h"
 
 
 MeshModel::MeshModel() = default;
 
-MeshModel::MeshModel(std::vector<Mesh> newMeshList) {
+MeshModel::MeshModel(std::vector<Mesh> newMeshList, NodeHierarchy newNodes, std::vector<uint32_t> newMeshNodes) {
 	meshList = newMeshList;
 	model = glm::mat4(1.0f);
+	nodes = newNodes;
+	meshNodes = newMeshNodes;
+
+	// Models without a hierarchy get a single root every mesh hangs from
+	if (nodes.getNodeCount() == 0) {
+		nodes.addNode(-1, glm::mat4(1.0f));
+	}
+	meshNodes.resize(meshList.size(), 0);
+	for (auto& node : meshNodes) {
+		if (node >= nodes.getNodeCount()) {
+			throw std::runtime_error("Mesh refers to an invalid node!");
+		}
+	}
+
+	// Model matrix is still identity, so world transforms are model space ones
+	nodes.setRootTransform(model);
+	nodes.update();
+
+	// Mesh spheres in model space (radius grows with the node's largest axis scale)
+	std::vector<glm::vec3> centers(meshList.size());
+	std::vector<float> radii(meshList.size());
+	for (size_t i = 0; i < meshList.size(); i++) {
+		glm::mat4 transform = nodes.getWorldTransform(meshNodes[i]);
+		float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+		centers[i] = glm::vec3(transform * glm::vec4(meshList[i].getBoundsCenter(), 1.0f));
+		radii[i] = meshList[i].getBoundsRadius() * scale;
+	}
+
+	// Sphere around the box of the mesh spheres
+	boundsCenter = glm::vec3(0.0f);
+	boundsRadius = 0.0f;
+	if (!meshList.empty()) {
+		glm::vec3 boundsMin = centers[0] - glm::vec3(radii[0]);
+		glm::vec3 boundsMax = centers[0] + glm::vec3(radii[0]);
+		for (size_t i = 0; i < meshList.size(); i++) {
+			boundsMin = glm::min(boundsMin, centers[i] - glm::vec3(radii[i]));
+			boundsMax = glm::max(boundsMax, centers[i] + glm::vec3(radii[i]));
+		}
+		boundsCenter = (boundsMin + boundsMax) * 0.5f;
+		for (size_t i = 0; i < meshList.size(); i++) {
+			boundsRadius = std::max(boundsRadius, glm::length(centers[i] - boundsCenter) + radii[i]);
+		}
+	}
 }
 
 size_t MeshModel::getMeshCount() {
@@ -27,6 +74,51 @@ glm::mat4 MeshModel::getModel() {
 
 void MeshModel::setModel(glm::mat4 newModel) {
 	model = newModel;
+	nodes.setRootTransform(model);
+}
+
+size_t MeshModel::getNodeCount() {
+	return nodes.getNodeCount();
+}
+
+void MeshModel::setNodeTransform(uint32_t node, glm::mat4 localTransform) {
+	if (node >= nodes.getNodeCount()) {
+		throw std::runtime_error("Attempted to access invalid Node index!");
+	}
+	nodes.setLocalTransform(node, localTransform);
+}
+
+void MeshModel::updateTransforms() {
+	nodes.update();
+}
+
+glm::mat4 MeshModel::getMeshTransform(size_t index) {
+	if (index >= meshList.size()) {
+		throw std::runtime_error("Attempted to access invalid Mesh index!");
+	}
+	return nodes.getWorldTransform(meshNodes[index]);
+}
+
+glm::mat4 MeshModel::getMeshModelTransform(size_t index) {
+	if (index >= meshList.size()) {
+		throw std::runtime_error("Attempted to access invalid Mesh index!");
+	}
+	return nodes.getModelTransform(meshNodes[index]);
+}
+
+uint32_t MeshModel::getMeshNode(size_t index) {
+	if (index >= meshList.size()) {
+		throw std::runtime_error("Attempted to access invalid Mesh index!");
+	}
+	return meshNodes[index];
+}
+
+glm::vec3 MeshModel::getBoundsCenter() {
+	return boundsCenter;
+}
+
+float MeshModel::getBoundsRadius() {
+	return boundsRadius;
 }
 
 void MeshModel::destroyMeshModel() {
@@ -64,64 +156,80 @@ std::vector<std::string> MeshModel::LoadMaterials(const aiScene * scene) {
 	return textureList;
 }
 
-std::vector<Mesh> MeshModel::LoadNode(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool, aiNode * node, const aiScene * scene, std::vector<int> matToTex) {
-	std::vector<Mesh> meshList;
+std::vector<MeshData> MeshModel::LoadNode(aiNode * node, const aiScene * scene, const std::vector<int>& matToTex,
+	NodeHierarchy * nodes, ThreadPool * pool) {
+	// Flatten node tree depth first (node's meshes, then its children), which is also the order the hierarchy needs
+	std::vector<aiMesh *> meshes;
+	std::vector<uint32_t> meshNodes;
+	std::vector<std::pair<aiNode *, int32_t>> nodeStack = { { node, -1 } };
+	while (!nodeStack.empty()) {
+		aiNode * current = nodeStack.back().first;
+		int32_t parent = nodeStack.back().second;
+		nodeStack.pop_back();
+
+		// Assimp matrices are row major, glm takes columns
+		const aiMatrix4x4 & t = current->mTransformation;
+		glm::mat4 localTransform(glm::vec4(t.a1, t.b1, t.c1, t.d1), glm::vec4(t.a2, t.b2, t.c2, t.d2),
+			glm::vec4(t.a3, t.b3, t.c3, t.d3), glm::vec4(t.a4, t.b4, t.c4, t.d4));
+		uint32_t nodeIndex = nodes->addNode(parent, localTransform);
+
+		for (size_t i = 0; i < current->mNumMeshes; i++) {
+			meshes.push_back(scene->mMeshes[current->mMeshes[i]]);
+			meshNodes.push_back(nodeIndex);
+		}
 
-	// Go through each mesh at this node and create it, then add it to our meshList
-	for (size_t i = 0; i < node->mNumMeshes; i++) {
-		meshList.push_back(
-			LoadMesh(newPhysicalDevice, newDevice, transferQueue, transferCommandPool, scene->mMeshes[node->mMeshes[i]], scene, matToTex)
-		);
+		// Push children in reverse so the first child is visited next
+		for (size_t i = current->mNumChildren; i > 0; i--) {
+			nodeStack.push_back({ current->mChildren[i - 1], static_cast<int32_t>(nodeIndex) });
+		}
 	}
 
-	// Go through each node attached to this node and load it, then append their meshes to this node's mesh list
-	for (size_t i = 0; i < node->mNumChildren; i++) {
-		std::vector<Mesh> newList = LoadNode(newPhysicalDevice, newDevice, transferQueue, transferCommandPool, node->mChildren[i], scene, matToTex);
-		meshList.insert(meshList.end(), newList.begin(), newList.end());
+	// One output slot per mesh, each is converted independently
+	std::vector<MeshData> meshList(meshes.size());
+	auto convert = [&](size_t i) {
+		LoadMesh(meshes[i], matToTex, &meshList[i]);
+		meshList[i].node = meshNodes[i];
+	};
+
+	if (pool) {
+		pool->parallelFor(meshes.size(), convert);
+	}
+	else {
+		for (size_t i = 0; i < meshes.size(); i++) {
+			convert(i);
+		}
 	}
 
 	return meshList;
 }
 
-Mesh MeshModel::LoadMesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool, aiMesh * mesh, const aiScene * scene, std::vector<int> matToTex) {
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+void MeshModel::LoadMesh(aiMesh * mesh, const std::vector<int>& matToTex, MeshData * meshData) {
+	// Size both arrays up front, nothing is appended while converting
+	std::vector<Vertex>& vertices = meshData->vertices;
+	std::vector<uint32_t>& indices = meshData->indices;
 
-	// Resize vertex list to hold all vertices for mesh
-	vertices.resize(mesh->mNumVertices);
-
-	// Go through each vertex and copy it across to our vertices
-	for (size_t i = 0; i < mesh->mNumVertices; i++) {
-		// Set position
-		vertices[i].pos = { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z };
+	size_t indexCount = 0;
+	for (size_t i = 0; i < mesh->mNumFaces; i++) {
+		indexCount += mesh->mFaces[i].mNumIndices;
+	}
 
-		// Set tex coords (if they exist)
-		if (mesh->mTextureCoords[0]) {
-			vertices[i].tex = { mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y };
-		}
-		else {
-			vertices[i].tex = { 0.0f, 0.0f };
-		}
+	vertices.resize(mesh->mNumVertices);
+	indices.resize(indexCount);
 
-		// Set colour (just use white for now)
-		vertices[i].col = { 1.0f, 1.0f, 1.0f };
-	}
+	// Interleave positions and tex coords (if they exist) into our vertices, colour is just white for now
+	VERTEX_CONVERT::convertVertices(mesh->mVertices, mesh->mTextureCoords[0], mesh->mNumVertices, vertices.data());
 
 	// Iterate over indices through faces and copy across
+	uint32_t * index = indices.data();
 	for (size_t i = 0; i < mesh->mNumFaces; i++) {
-		// Get a face
-		aiFace face = mesh->mFaces[i];
-
-		// Go through face's indices and add to list
+		const aiFace & face = mesh->mFaces[i];
 		for (size_t j = 0; j < face.mNumIndices; j++) {
-			indices.push_back(face.mIndices[j]);
+			*index++ = face.mIndices[j];
 		}
 	}
 
-	// Create new mesh with details and return it
-	Mesh newMesh = Mesh(newPhysicalDevice, newDevice, transferQueue, transferCommandPool, &vertices, &indices, matToTex[mesh->mMaterialIndex]);
-
-	return newMesh;
+	// Texture of mesh's material
+	meshData->texId = matToTex[mesh->mMaterialIndex];
 }
 
 
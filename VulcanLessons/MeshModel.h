@@ -7,12 +7,25 @@
 #include <assimp/scene.h>
 
 #include "Mesh.h"
+#include "NodeHierarchy.h"
+#include "ThreadPool.h"
+
+// CPU side geometry of one mesh, before it is placed in the geometry arena
+struct MeshData {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;		// Every LOD's indices one after another
+	std::vector<MeshLod> lods;			// Empty = indices are a single full detail level
+	std::vector<Meshlet> meshlets;		// Ranges of the full detail level (empty = mesh is drawn whole)
+	int texId;
+	uint32_t node;						// Node of the model's hierarchy the mesh is placed by
+};
 
 class MeshModel
 {
 public:
 	MeshModel();
-	MeshModel(std::vector<Mesh> newMeshList);
+	// Meshes are placed by the node of the same index in newMeshNodes (no nodes = one identity root holding every mesh)
+	MeshModel(std::vector<Mesh> newMeshList, NodeHierarchy newNodes = NodeHierarchy(), std::vector<uint32_t> newMeshNodes = {});
 
 	size_t getMeshCount();
 	Mesh * getMesh(size_t index);
@@ -20,18 +33,40 @@ public:
 	glm::mat4 getModel();
 	void setModel(glm::mat4 newModel);
 
+	size_t getNodeCount();
+	// Move a node relative to its parent (takes effect on the next updateTransforms)
+	void setNodeTransform(uint32_t node, glm::mat4 localTransform);
+	// Recompute the mesh transforms changed by setModel/setNodeTransform since the last call
+	void updateTransforms();
+	// World transform of a mesh (model matrix * its node's transform), as of the last updateTransforms
+	glm::mat4 getMeshTransform(size_t index);
+	// Same without the model matrix (the node's transform in model space)
+	glm::mat4 getMeshModelTransform(size_t index);
+	uint32_t getMeshNode(size_t index);
+
+	// Bounding sphere of all meshes (placed by their nodes), in model space
+	glm::vec3 getBoundsCenter();
+	float getBoundsRadius();
+
 	void destroyMeshModel();
 
 	static std::vector<std::string> LoadMaterials(const aiScene * scene);
-	static std::vector<Mesh> LoadNode(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
-		aiNode * node, const aiScene * scene, std::vector<int> matToTex);
-	static Mesh LoadMesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool transferCommandPool,
-		aiMesh * mesh, const aiScene * scene, std::vector<int> matToTex);
+	// Converts every mesh below node, in parallel on pool if one is given. The nodes themselves are appended to nodes
+	// (meshes refer to them by index)
+	static std::vector<MeshData> LoadNode(aiNode * node, const aiScene * scene, const std::vector<int>& matToTex,
+		NodeHierarchy * nodes, ThreadPool * pool = nullptr);
+	static void LoadMesh(aiMesh * mesh, const std::vector<int>& matToTex, MeshData * meshData);
 
 	~MeshModel();
 
 private:
 	std::vector<Mesh> meshList;
 	glm::mat4 model;
+
+	NodeHierarchy nodes;
+	std::vector<uint32_t> meshNodes;		// 1:1 with meshList
+
+	glm::vec3 boundsCenter;
+	float boundsRadius;
 };
 
@@ -0,0 +1,676 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+
+// FORSYTH SCORING
+// Vertices recently used score high (except the last triangle's, to avoid strips turning back on themselves),
+// vertices with few triangles left score high too so they get finished off
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static float getVertexScore(int cachePosition, uint32_t remainingTriangles) {
+	if (remainingTriangles == 0) {
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else {
+			float scaler = 1.0f / (VERTEX_CACHE_OPTIMIZE_SIZE - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+
+	return score + VALENCE_BOOST_SCALE * powf(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+namespace MESH_OPTIMIZER {
+
+	VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+		VertexCacheStats stats;
+		stats.triangleCount = static_cast<uint32_t>(indexCount / 3);
+
+		// FIFO cache: a vertex is still cached if it was added less than cacheSize misses ago
+		std::vector<uint32_t> cacheTime(vertexCount, 0);
+		std::vector<bool> used(vertexCount, false);
+		uint32_t time = cacheSize + 1;
+
+		for (size_t i = 0; i < indexCount; i++) {
+			uint32_t vertex = indices[i];
+			if (time - cacheTime[vertex] > cacheSize) {
+				cacheTime[vertex] = time++;
+				stats.misses++;
+			}
+			if (!used[vertex]) {
+				used[vertex] = true;
+				stats.vertexCount++;
+			}
+		}
+
+		if (stats.triangleCount > 0) {
+			stats.acmr = static_cast<float>(stats.misses) / stats.triangleCount;
+		}
+		if (stats.vertexCount > 0) {
+			stats.atvr = static_cast<float>(stats.misses) / stats.vertexCount;
+		}
+		return stats;
+	}
+
+	void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount) {
+		size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// VERTEX -> TRIANGLE ADJACENCY
+		// Triangles of vertex v are adjacency[adjacencyOffset[v]..+remaining[v]], emitted ones are swapped out of the range
+		std::vector<uint32_t> remaining(vertexCount, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			remaining[indices[i]]++;
+		}
+
+		std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; v++) {
+			adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+		}
+
+		std::vector<uint32_t> adjacency(triangleCount * 3);
+		std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++) {
+			for (int k = 0; k < 3; k++) {
+				adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+			}
+		}
+
+		// SCORES
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			vertexScore[v] = getVertexScore(-1, remaining[v]);
+		}
+
+		std::vector<bool> emitted(triangleCount, false);
+
+		// Cache holds at most VERTEX_CACHE_OPTIMIZE_SIZE + 3 vertices while being updated
+		std::vector<uint32_t> cache;
+		std::vector<uint32_t> newCache;
+		cache.reserve(VERTEX_CACHE_OPTIMIZE_SIZE + 3);
+		newCache.reserve(VERTEX_CACHE_OPTIMIZE_SIZE + 3);
+
+		std::vector<uint32_t> result(triangleCount * 3);
+		size_t scanCursor = 0;
+		int64_t bestTriangle = -1;
+
+		for (size_t output = 0; output < triangleCount; output++) {
+			// Nothing in cache has triangles left, take next unused triangle in input order
+			if (bestTriangle < 0) {
+				while (emitted[scanCursor]) {
+					scanCursor++;
+				}
+				bestTriangle = static_cast<int64_t>(scanCursor);
+			}
+
+			uint32_t triangle = static_cast<uint32_t>(bestTriangle);
+			const uint32_t* triangleIndices = indices + triangle * 3;
+			result[output * 3] = triangleIndices[0];
+			result[output * 3 + 1] = triangleIndices[1];
+			result[output * 3 + 2] = triangleIndices[2];
+			emitted[triangle] = true;
+
+			// Remove triangle from its vertices' lists
+			for (int k = 0; k < 3; k++) {
+				uint32_t vertex = triangleIndices[k];
+				uint32_t* list = adjacency.data() + adjacencyOffset[vertex];
+				for (uint32_t i = 0; i < remaining[vertex]; i++) {
+					if (list[i] == triangle) {
+						list[i] = list[remaining[vertex] - 1];
+						remaining[vertex]--;
+						break;
+					}
+				}
+			}
+
+			// Triangle's vertices move to the front of the cache (once each, degenerate triangles repeat them)
+			newCache.clear();
+			for (int k = 0; k < 3; k++) {
+				if (std::find(newCache.begin(), newCache.end(), triangleIndices[k]) == newCache.end()) {
+					newCache.push_back(triangleIndices[k]);
+				}
+			}
+			for (uint32_t vertex : cache) {
+				if (std::find(newCache.begin(), newCache.end(), vertex) == newCache.end()) {
+					newCache.push_back(vertex);
+				}
+			}
+
+			// Evicted vertices lose their cache bonus (their triangles are only scored again once a vertex is cached)
+			for (size_t i = VERTEX_CACHE_OPTIMIZE_SIZE; i < newCache.size(); i++) {
+				cachePosition[newCache[i]] = -1;
+				vertexScore[newCache[i]] = getVertexScore(-1, remaining[newCache[i]]);
+			}
+			if (newCache.size() > VERTEX_CACHE_OPTIMIZE_SIZE) {
+				newCache.resize(VERTEX_CACHE_OPTIMIZE_SIZE);
+			}
+			cache.swap(newCache);
+
+			// Rescore cached vertices and their triangles, best of those goes next
+			for (size_t i = 0; i < cache.size(); i++) {
+				cachePosition[cache[i]] = static_cast<int>(i);
+				vertexScore[cache[i]] = getVertexScore(static_cast<int>(i), remaining[cache[i]]);
+			}
+
+			bestTriangle = -1;
+			float bestScore = -1.0f;
+			for (uint32_t vertex : cache) {
+				const uint32_t* list = adjacency.data() + adjacencyOffset[vertex];
+				for (uint32_t j = 0; j < remaining[vertex]; j++) {
+					const uint32_t* tri = indices + list[j] * 3;
+					float score = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+					if (score > bestScore) {
+						bestScore = score;
+						bestTriangle = list[j];
+					}
+				}
+			}
+		}
+
+		std::copy(result.begin(), result.end(), indices);
+	}
+
+	void optimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount) {
+		size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// CLUSTERS
+		// A triangle whose 3 vertices all miss the cache starts a cluster: the cache is cold there anyway,
+		// so clusters can be moved around without losing reuse
+		std::vector<uint32_t> clusterStarts;
+		std::vector<uint32_t> cacheTime(vertexCount, 0);
+		uint32_t time = VERTEX_CACHE_STATS_SIZE + 1;
+		for (size_t t = 0; t < triangleCount; t++) {
+			int misses = 0;
+			for (int k = 0; k < 3; k++) {
+				uint32_t vertex = indices[t * 3 + k];
+				if (time - cacheTime[vertex] > VERTEX_CACHE_STATS_SIZE) {
+					cacheTime[vertex] = time++;
+					misses++;
+				}
+			}
+			if (t == 0 || misses == 3) {
+				clusterStarts.push_back(static_cast<uint32_t>(t));
+			}
+		}
+		clusterStarts.push_back(static_cast<uint32_t>(triangleCount));
+
+		// Mesh centre (area weighted)
+		struct Cluster {
+			uint32_t first;
+			uint32_t count;
+			float sortKey;
+		};
+		std::vector<Cluster> clusters(clusterStarts.size() - 1);
+
+		glm::vec3 meshCentroid(0.0f);
+		float meshArea = 0.0f;
+		for (size_t t = 0; t < triangleCount; t++) {
+			const glm::vec3& p0 = vertices[indices[t * 3]].pos;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+			float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+			meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+			meshArea += area;
+		}
+		if (meshArea > 0.0f) {
+			meshCentroid /= meshArea;
+		}
+
+		// Clusters facing away from the centre are likely in front of the rest of the mesh, draw those first
+		for (size_t c = 0; c < clusters.size(); c++) {
+			clusters[c].first = clusterStarts[c];
+			clusters[c].count = clusterStarts[c + 1] - clusterStarts[c];
+
+			glm::vec3 centroid(0.0f);
+			glm::vec3 normal(0.0f);
+			float area = 0.0f;
+			for (uint32_t t = clusters[c].first; t < clusters[c].first + clusters[c].count; t++) {
+				const glm::vec3& p0 = vertices[indices[t * 3]].pos;
+				const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+				const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+				glm::vec3 triangleNormal = glm::cross(p1 - p0, p2 - p0);		// Length = 2 * area
+				float triangleArea = glm::length(triangleNormal);
+				centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+				normal += triangleNormal;
+				area += triangleArea;
+			}
+
+			clusters[c].sortKey = 0.0f;
+			float normalLength = glm::length(normal);
+			if (area > 0.0f && normalLength > 0.0f) {
+				clusters[c].sortKey = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+			}
+		}
+
+		std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+			return a.sortKey > b.sortKey;
+		});
+
+		std::vector<uint32_t> result;
+		result.reserve(triangleCount * 3);
+		for (auto& cluster : clusters) {
+			result.insert(result.end(), indices + cluster.first * 3, indices + (cluster.first + cluster.count) * 3);
+		}
+		std::copy(result.begin(), result.end(), indices);
+	}
+
+	void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+		const uint32_t unused = ~0u;
+		std::vector<uint32_t> remap(vertices.size(), unused);
+		std::vector<Vertex> result;
+		result.reserve(vertices.size());
+
+		for (auto& index : indices) {
+			if (remap[index] == unused) {
+				remap[index] = static_cast<uint32_t>(result.size());
+				result.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+
+		vertices.swap(result);
+	}
+
+	void optimizeMesh(MeshData& mesh, VertexCacheStats* before, VertexCacheStats* after) {
+		size_t indexCount = mesh.indices.size();
+
+		if (before) {
+			*before = analyzeVertexCache(mesh.indices.data(), indexCount, mesh.vertices.size());
+		}
+
+		// Only plain triangle lists can be reordered (Triangulate still leaves point and line faces)
+		if (indexCount % 3 != 0) {
+			if (after) {
+				*after = analyzeVertexCache(mesh.indices.data(), indexCount, mesh.vertices.size());
+			}
+			return;
+		}
+
+		optimizeVertexCache(mesh.indices.data(), indexCount, mesh.vertices.size());
+		optimizeOverdraw(mesh.indices.data(), indexCount, mesh.vertices.data(), mesh.vertices.size());
+		optimizeVertexFetch(mesh.vertices, mesh.indices);
+
+		if (after) {
+			*after = analyzeVertexCache(mesh.indices.data(), indexCount, mesh.vertices.size());
+		}
+	}
+}
+
+// QUADRIC SIMPLIFICATION
+// Symmetric 4x4 quadric of planes: error(p) = p'Ap + 2b.p + c = sum of squared distances of p to the planes
+struct Quadric {
+	double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+	double b0 = 0, b1 = 0, b2 = 0;
+	double c = 0;
+
+	void addPlane(double nx, double ny, double nz, double d) {
+		a00 += nx * nx; a01 += nx * ny; a02 += nx * nz;
+		a11 += ny * ny; a12 += ny * nz; a22 += nz * nz;
+		b0 += nx * d; b1 += ny * d; b2 += nz * d;
+		c += d * d;
+	}
+
+	void add(const Quadric& other) {
+		a00 += other.a00; a01 += other.a01; a02 += other.a02;
+		a11 += other.a11; a12 += other.a12; a22 += other.a22;
+		b0 += other.b0; b1 += other.b1; b2 += other.b2;
+		c += other.c;
+	}
+
+	double error(const glm::vec3& p) const {
+		double x = p.x, y = p.y, z = p.z;
+		double result = a00 * x * x + a11 * y * y + a22 * z * z
+			+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+			+ 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+		return result > 0.0 ? result : 0.0;
+	}
+};
+
+namespace MESH_OPTIMIZER {
+
+	float getMeshRadius(const std::vector<Vertex>& vertices) {
+		if (vertices.empty()) {
+			return 0.0f;
+		}
+
+		glm::vec3 boundsMin = vertices[0].pos;
+		glm::vec3 boundsMax = vertices[0].pos;
+		for (auto& vertex : vertices) {
+			boundsMin = glm::min(boundsMin, vertex.pos);
+			boundsMax = glm::max(boundsMax, vertex.pos);
+		}
+		return glm::length(boundsMax - boundsMin) * 0.5f;
+	}
+
+	std::vector<uint32_t> simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		size_t targetIndexCount, float maxError, float* resultError) {
+		std::vector<uint32_t> result = indices;
+		*resultError = 0.0f;
+		size_t vertexCount = vertices.size();
+		if (result.size() % 3 != 0) {
+			return result;
+		}
+
+		// Plane of every triangle goes into its vertices' quadrics
+		std::vector<Quadric> quadrics(vertexCount);
+		for (size_t i = 0; i < result.size(); i += 3) {
+			const glm::vec3& p0 = vertices[result[i]].pos;
+			const glm::vec3& p1 = vertices[result[i + 1]].pos;
+			const glm::vec3& p2 = vertices[result[i + 2]].pos;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			if (length <= 0.0f) {
+				continue;
+			}
+			normal = normal / length;
+
+			for (int k = 0; k < 3; k++) {
+				quadrics[result[i + k]].addPlane(normal.x, normal.y, normal.z, -glm::dot(normal, p0));
+			}
+		}
+
+		// Border edges (one triangle) are locked: open borders and UV seams (split vertices) keep their outline
+		std::vector<bool> locked(vertexCount, false);
+		{
+			std::map<std::pair<uint32_t, uint32_t>, int> edgeUse;
+			for (size_t i = 0; i < result.size(); i += 3) {
+				for (int k = 0; k < 3; k++) {
+					uint32_t a = result[i + k];
+					uint32_t b = result[i + (k + 1) % 3];
+					edgeUse[std::make_pair(std::min(a, b), std::max(a, b))]++;
+				}
+			}
+			for (auto& edge : edgeUse) {
+				if (edge.second == 1) {
+					locked[edge.first.first] = true;
+					locked[edge.first.second] = true;
+				}
+			}
+		}
+
+		double maxErrorSquared = static_cast<double>(maxError) * maxError;
+
+		struct Collapse {
+			uint32_t from;
+			uint32_t to;
+			double cost;
+		};
+		std::vector<Collapse> collapses;
+		std::vector<uint32_t> remap(vertexCount);
+		std::vector<bool> touched(vertexCount);
+		std::vector<uint32_t> triangleOffset(vertexCount + 1);
+		std::vector<uint32_t> vertexTriangles;
+
+		// Each pass collapses a set of edges that don't share neighbourhoods, cheapest first
+		while (result.size() > targetIndexCount) {
+			size_t triangleCount = result.size() / 3;
+
+			// Vertex -> triangles of this pass
+			std::fill(triangleOffset.begin(), triangleOffset.end(), 0);
+			for (uint32_t index : result) {
+				triangleOffset[index + 1]++;
+			}
+			for (size_t v = 0; v < vertexCount; v++) {
+				triangleOffset[v + 1] += triangleOffset[v];
+			}
+			vertexTriangles.resize(result.size());
+			std::vector<uint32_t> fill(triangleOffset.begin(), triangleOffset.end() - 1);
+			for (size_t t = 0; t < triangleCount; t++) {
+				for (int k = 0; k < 3; k++) {
+					vertexTriangles[fill[result[t * 3 + k]]++] = static_cast<uint32_t>(t);
+				}
+			}
+
+			// Candidates: move one end of an edge onto the other
+			collapses.clear();
+			for (size_t t = 0; t < triangleCount; t++) {
+				for (int k = 0; k < 3; k++) {
+					uint32_t a = result[t * 3 + k];
+					uint32_t b = result[t * 3 + (k + 1) % 3];
+					for (int direction = 0; direction < 2; direction++) {
+						uint32_t from = direction ? b : a;
+						uint32_t to = direction ? a : b;
+						if (locked[from]) {
+							continue;
+						}
+
+						Quadric combined = quadrics[from];
+						combined.add(quadrics[to]);
+						double cost = combined.error(vertices[to].pos);
+						if (cost <= maxErrorSquared) {
+							collapses.push_back({ from, to, cost });
+						}
+					}
+				}
+			}
+
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+				return a.cost < b.cost;
+			});
+
+			for (size_t v = 0; v < vertexCount; v++) {
+				remap[v] = static_cast<uint32_t>(v);
+			}
+			std::fill(touched.begin(), touched.end(), false);
+
+			// Each interior collapse removes about 2 triangles
+			size_t estimatedIndexCount = result.size();
+			size_t appliedCount = 0;
+			for (auto& collapse : collapses) {
+				if (estimatedIndexCount <= targetIndexCount) {
+					break;
+				}
+				if (touched[collapse.from] || touched[collapse.to]) {
+					continue;
+				}
+
+				// Reject collapses that flip a remaining triangle around the moved vertex
+				const glm::vec3& target = vertices[collapse.to].pos;
+				bool flips = false;
+				for (uint32_t i = triangleOffset[collapse.from]; i < triangleOffset[collapse.from + 1] && !flips; i++) {
+					const uint32_t* triangle = result.data() + vertexTriangles[i] * 3;
+					if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+						continue;		// Collapses to nothing
+					}
+
+					glm::vec3 p[3];
+					glm::vec3 moved[3];
+					for (int k = 0; k < 3; k++) {
+						p[k] = vertices[triangle[k]].pos;
+						moved[k] = triangle[k] == collapse.from ? target : p[k];
+					}
+					glm::vec3 normalBefore = glm::cross(p[1] - p[0], p[2] - p[0]);
+					glm::vec3 normalAfter = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+					flips = glm::dot(normalBefore, normalAfter) <= 0.0f;
+				}
+				if (flips) {
+					continue;
+				}
+
+				remap[collapse.from] = collapse.to;
+				quadrics[collapse.to].add(quadrics[collapse.from]);
+				*resultError = std::max(*resultError, static_cast<float>(sqrt(collapse.cost)));
+
+				// Whole neighbourhood is fixed for the rest of the pass, so the flip checks stay valid
+				for (uint32_t i = triangleOffset[collapse.from]; i < triangleOffset[collapse.from + 1]; i++) {
+					const uint32_t* triangle = result.data() + vertexTriangles[i] * 3;
+					touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+				}
+				touched[collapse.to] = true;
+
+				estimatedIndexCount = estimatedIndexCount > 6 ? estimatedIndexCount - 6 : 0;
+				appliedCount++;
+			}
+
+			if (appliedCount == 0) {
+				break;
+			}
+
+			// Move collapsed vertices and drop triangles that became degenerate
+			size_t writeIndex = 0;
+			for (size_t t = 0; t < triangleCount; t++) {
+				uint32_t a = remap[result[t * 3]];
+				uint32_t b = remap[result[t * 3 + 1]];
+				uint32_t c = remap[result[t * 3 + 2]];
+				if (a == b || b == c || a == c) {
+					continue;
+				}
+				result[writeIndex++] = a;
+				result[writeIndex++] = b;
+				result[writeIndex++] = c;
+			}
+			result.resize(writeIndex);
+		}
+
+		return result;
+	}
+
+	void generateLods(MeshData& mesh) {
+		uint32_t fullIndexCount = static_cast<uint32_t>(mesh.indices.size());
+		mesh.lods.assign(1, MeshLod{ 0, fullIndexCount, 0.0f });
+		if (fullIndexCount % 3 != 0) {
+			return;
+		}
+
+		float maxError = LOD_MAX_ERROR * getMeshRadius(mesh.vertices);
+		std::vector<uint32_t> fullIndices(mesh.indices.begin(), mesh.indices.end());
+		size_t previousIndexCount = fullIndices.size();
+
+		// Every level starts from full detail, so its error is measured against the real surface
+		while (mesh.lods.size() < MAX_MESH_LODS) {
+			size_t targetIndexCount = previousIndexCount / 2 / 3 * 3;
+
+			float error = 0.0f;
+			std::vector<uint32_t> lodIndices = simplify(mesh.vertices, fullIndices, targetIndexCount, maxError, &error);
+
+			// Not worth a level if the error bound stopped it early
+			if (lodIndices.empty() || lodIndices.size() > previousIndexCount * LOD_MIN_REDUCTION) {
+				break;
+			}
+
+			optimizeVertexCache(lodIndices.data(), lodIndices.size(), mesh.vertices.size());
+
+			mesh.lods.push_back(MeshLod{ static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(lodIndices.size()), error });
+			mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.end());
+			previousIndexCount = lodIndices.size();
+		}
+	}
+
+	void buildMeshlets(MeshData& mesh) {
+		mesh.meshlets.clear();
+		uint32_t fullIndexCount = mesh.lods.empty() ? static_cast<uint32_t>(mesh.indices.size()) : mesh.lods[0].indexCount;
+		if (fullIndexCount % 3 != 0) {
+			return;
+		}
+
+		// Triangles are already in cache order, which keeps neighbours together, so cut it wherever a limit is hit
+		std::vector<uint32_t> usedBy(mesh.vertices.size(), UINT32_MAX);		// Meshlet that last counted the vertex
+		std::vector<uint32_t> meshletVertices;
+		uint32_t meshletStart = 0;
+
+		auto finishMeshlet = [&](uint32_t end) {
+			Meshlet meshlet = {};
+			meshlet.firstIndex = meshletStart;
+			meshlet.indexCount = end - meshletStart;
+
+			// Sphere around the box of the meshlet's vertices
+			glm::vec3 boundsMin = mesh.vertices[meshletVertices[0]].pos;
+			glm::vec3 boundsMax = boundsMin;
+			for (uint32_t vertex : meshletVertices) {
+				boundsMin = glm::min(boundsMin, mesh.vertices[vertex].pos);
+				boundsMax = glm::max(boundsMax, mesh.vertices[vertex].pos);
+			}
+			meshlet.center = (boundsMin + boundsMax) * 0.5f;
+			for (uint32_t vertex : meshletVertices) {
+				meshlet.radius = std::max(meshlet.radius, glm::length(mesh.vertices[vertex].pos - meshlet.center));
+			}
+
+			// Normal cone: axis is the average face normal, cutoff comes from the normal furthest from it
+			std::vector<glm::vec3> normals;
+			glm::vec3 axis(0.0f);
+			for (uint32_t i = meshletStart; i < end; i += 3) {
+				glm::vec3 p0 = mesh.vertices[mesh.indices[i]].pos;
+				glm::vec3 p1 = mesh.vertices[mesh.indices[i + 1]].pos;
+				glm::vec3 p2 = mesh.vertices[mesh.indices[i + 2]].pos;
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float length = glm::length(normal);
+				if (length > 0.0f) {
+					normals.push_back(normal / length);
+					axis += normal / length;
+				}
+			}
+
+			// Cutoff 1 never culls (normals spread too wide, or no real triangles)
+			meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+			meshlet.coneCutoff = 1.0f;
+			float axisLength = glm::length(axis);
+			if (axisLength > 0.0f) {
+				axis /= axisLength;
+				float minDot = 1.0f;
+				for (auto& normal : normals) {
+					minDot = std::min(minDot, glm::dot(axis, normal));
+				}
+
+				// Faces point within acos(minDot) of the axis, so every face is back facing for views from inside
+				// the cone around -axis that is 90 degrees wider: cos(90 - spread) = sqrt(1 - minDot^2)
+				meshlet.coneAxis = axis;
+				if (minDot > 0.1f) {
+					meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+				}
+			}
+
+			mesh.meshlets.push_back(meshlet);
+			meshletStart = end;
+			meshletVertices.clear();
+		};
+
+		for (uint32_t i = 0; i < fullIndexCount; i += 3) {
+			uint32_t meshletIndex = static_cast<uint32_t>(mesh.meshlets.size());
+			uint32_t newVertices = 0;
+			for (uint32_t k = 0; k < 3; k++) {
+				// Repeated vertex inside the triangle only counts once
+				uint32_t vertex = mesh.indices[i + k];
+				bool repeated = (k > 0 && mesh.indices[i] == vertex) || (k > 1 && mesh.indices[i + 1] == vertex);
+				if (usedBy[vertex] != meshletIndex && !repeated) {
+					newVertices++;
+				}
+			}
+
+			if (i > meshletStart && (meshletVertices.size() + newVertices > MESHLET_MAX_VERTICES
+				|| (i - meshletStart) / 3 >= MESHLET_MAX_TRIANGLES)) {
+				finishMeshlet(i);
+				meshletIndex++;
+			}
+
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t vertex = mesh.indices[i + k];
+				if (usedBy[vertex] != meshletIndex) {
+					usedBy[vertex] = meshletIndex;
+					meshletVertices.push_back(vertex);
+				}
+			}
+		}
+
+		if (fullIndexCount > meshletStart) {
+			finishMeshlet(fullIndexCount);
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include "MeshModel.h"
+
+// FIFO cache size the reported stats are measured with (close to what most GPUs reuse)
+const uint32_t VERTEX_CACHE_STATS_SIZE = 16;
+// Cache size the triangle order is tuned for
+const uint32_t VERTEX_CACHE_OPTIMIZE_SIZE = 32;
+
+// LOD chain: each level aims for half the triangles of the one before, within an error bound
+const size_t MAX_MESH_LODS = 4;						// Including full detail
+const float LOD_MAX_ERROR = 0.05f;					// Relative to the mesh's bounding radius
+const float LOD_MIN_REDUCTION = 0.8f;				// A level must have at most this much of the previous level's indices
+
+// Meshlet limits (same as common mesh shader limits, so clusters are a size GPUs handle well either way)
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Post-transform vertex cache efficiency of an index list
+struct VertexCacheStats {
+	float acmr = 0.0f;			// Average cache miss ratio: transformed vertices per triangle (0.5 - 3, lower is better)
+	float atvr = 0.0f;			// Average transform to vertex ratio: transformed vertices per used vertex (1 is ideal)
+	uint32_t misses = 0;
+	uint32_t triangleCount = 0;
+	uint32_t vertexCount = 0;	// Vertices actually referenced
+};
+
+// Processes triangle lists (indices are relative to the mesh) after import:
+// reorders triangles for vertex cache reuse, then clusters of them for less overdraw, then vertices in first use order,
+// and builds simplified LOD index lists and meshlets
+namespace MESH_OPTIMIZER {
+	VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+		uint32_t cacheSize = VERTEX_CACHE_STATS_SIZE);
+
+	// Forsyth's linear speed vertex cache optimisation
+	void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+	// Split cache optimised order where the cache starts cold anyway and put outward facing clusters first
+	void optimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount);
+	// Renumber vertices in the order indices first use them (unused vertices are dropped)
+	void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	// All passes above, stats filled before and after (may be nullptr)
+	void optimizeMesh(MeshData& mesh, VertexCacheStats* before, VertexCacheStats* after);
+
+	// Half the bounding box diagonal
+	float getMeshRadius(const std::vector<Vertex>& vertices);
+	// Quadric edge collapse onto existing vertices (vertex list is unchanged, only the indices shrink).
+	// Stops at targetIndexCount or when no collapse stays under maxError (model space distance); resultError = error reached
+	std::vector<uint32_t> simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		size_t targetIndexCount, float maxError, float* resultError);
+	// Append simplified levels to mesh.indices and fill mesh.lods (level 0 = original indices)
+	void generateLods(MeshData& mesh);
+
+	// Cut the full detail level into runs of triangles within the meshlet limits (indices are not moved, so each
+	// meshlet is a range of them) and fill mesh.meshlets with their bounding spheres and normal cones
+	void buildMeshlets(MeshData& mesh);
+}
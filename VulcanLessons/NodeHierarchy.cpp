@@ -0,0 +1,86 @@
+#include "NodeHierarchy.h"
+
+#include <stdexcept>
+
+NodeHierarchy::NodeHierarchy() {
+	rootTransform = glm::mat4(1.0f);
+}
+
+uint32_t NodeHierarchy::addNode(int32_t parent, const glm::mat4& localTransform) {
+	uint32_t node = static_cast<uint32_t>(parents.size());
+
+	// Parent's subtree has to end right here, otherwise the new node would split another subtree's range
+	if (parent >= static_cast<int32_t>(node) || (parent >= 0 && subtreeEnds[parent] != node)) {
+		throw std::runtime_error("Failed to add a node, nodes must be added depth first!");
+	}
+
+	parents.push_back(parent);
+	subtreeEnds.push_back(node + 1);
+	localTransforms.push_back(localTransform);
+	worldTransforms.push_back(glm::mat4(1.0f));
+	modelTransforms.push_back(glm::mat4(1.0f));
+	dirty.push_back(1);
+
+	// Every ancestor's range now ends after the new node
+	for (int32_t ancestor = parent; ancestor >= 0; ancestor = parents[ancestor]) {
+		subtreeEnds[ancestor] = node + 1;
+	}
+
+	return node;
+}
+
+size_t NodeHierarchy::getNodeCount() const {
+	return parents.size();
+}
+
+int32_t NodeHierarchy::getParent(uint32_t node) const {
+	return parents[node];
+}
+
+const glm::mat4& NodeHierarchy::getLocalTransform(uint32_t node) const {
+	return localTransforms[node];
+}
+
+void NodeHierarchy::setLocalTransform(uint32_t node, const glm::mat4& localTransform) {
+	localTransforms[node] = localTransform;
+	dirty[node] = 1;
+}
+
+void NodeHierarchy::setRootTransform(const glm::mat4& newRootTransform) {
+	rootTransform = newRootTransform;
+
+	// Root subtrees cover the whole array back to back
+	for (uint32_t node = 0; node < parents.size(); node = subtreeEnds[node]) {
+		dirty[node] = 1;
+	}
+}
+
+void NodeHierarchy::update() {
+	uint32_t nodeCount = static_cast<uint32_t>(parents.size());
+	for (uint32_t node = 0; node < nodeCount;) {
+		if (!dirty[node]) {
+			node++;
+			continue;
+		}
+
+		// Whole subtree moves with a changed node, parents are always computed before their children
+		uint32_t end = subtreeEnds[node];
+		for (uint32_t i = node; i < end; i++) {
+			int32_t parent = parents[i];
+			modelTransforms[i] = parent < 0 ? localTransforms[i] : modelTransforms[parent] * localTransforms[i];
+			worldTransforms[i] = rootTransform * modelTransforms[i];
+			dirty[i] = 0;
+		}
+		node = end;
+	}
+}
+
+const glm::mat4& NodeHierarchy::getWorldTransform(uint32_t node) const {
+	return worldTransforms[node];
+}
+
+const glm::mat4& NodeHierarchy::getModelTransform(uint32_t node) const {
+	return modelTransforms[node];
+}
+
+NodeHierarchy::~NodeHierarchy() = default;
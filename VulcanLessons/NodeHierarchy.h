@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Node tree of a model, flattened depth first into arrays (structure of arrays).
+// Parents always come before their children and every subtree is one contiguous range,
+// so world transforms are rebuilt in a single forward pass over the ranges that changed.
+class NodeHierarchy {
+public:
+	NodeHierarchy();
+
+	// Append a node (-1 = root). Nodes must be added depth first: parent is the last added node or one of its ancestors
+	uint32_t addNode(int32_t parent, const glm::mat4& localTransform);
+
+	size_t getNodeCount() const;
+	int32_t getParent(uint32_t node) const;
+	const glm::mat4& getLocalTransform(uint32_t node) const;
+
+	// Marks the node's subtree for update
+	void setLocalTransform(uint32_t node, const glm::mat4& localTransform);
+	// Transform every root sits under (the model matrix), marks everything for update
+	void setRootTransform(const glm::mat4& newRootTransform);
+
+	// Recompute world transforms of nodes marked since the last update (and only those)
+	void update();
+	// Root transform * local transforms from the root down to the node, as of the last update
+	const glm::mat4& getWorldTransform(uint32_t node) const;
+	// Local transforms from the root down to the node without the root transform (model space), as of the last update
+	const glm::mat4& getModelTransform(uint32_t node) const;
+
+	~NodeHierarchy();
+
+private:
+	std::vector<int32_t> parents;
+	std::vector<uint32_t> subtreeEnds;			// One past the node's last descendant
+	std::vector<glm::mat4> localTransforms;
+	std::vector<glm::mat4> worldTransforms;
+	std::vector<glm::mat4> modelTransforms;
+	std::vector<uint8_t> dirty;					// World transform (and so its whole subtree) needs recomputing
+
+	glm::mat4 rootTransform;
+};
@@ -1,3 +1,9 @@
 C:\VulkanSDK\1.2.182.0\Bin32\glslangValidator.exe -V shader.vert
 C:\VulkanSDK\1.2.182.0\Bin32\glslangValidator.exe -V shader.frag
+C:\VulkanSDK\1.2.182.0\Bin32\glslangValidator.exe -V shader_compact.vert -o compact_vert.spv
+C:\VulkanSDK\1.2.182.0\Bin32\glslangValidator.exe -V shader_instanced.vert -o instanced_vert.spv
+C:\VulkanSDK\1.2.182.0\Bin32\glslangValidator.exe -V shader_compact_instanced.vert -o compact_instanced_vert.spv
+C:\VulkanSDK\1.2.182.0\Bin32\glslangValidator.exe -V cull.comp -o cull_comp.spv
+C:\VulkanSDK\1.2.182.0\Bin32\glslangValidator.exe -V draw_cull.comp -o draw_cull_comp.spv
+C:\VulkanSDK\1.2.182.0\Bin32\glslangValidator.exe -V depth_pyramid.comp -o depth_pyramid_comp.spv
 pause
\ No newline at end of file
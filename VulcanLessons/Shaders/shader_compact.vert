@@ -0,0 +1,25 @@
+#version 450 		// Use GLSL 4.5
+
+// CompactVertex: no colour, position is 0..1 inside the mesh bounds
+layout(location = 0) in vec4 pos;
+layout(location = 2) in vec2 tex;
+
+layout(set = 0, binding = 0) uniform UboViewProjection {
+	mat4 projection;
+	mat4 view;
+} uboViewProjection;
+
+// Model matrix with the mesh's dequantize (bounds scale + offset) already applied
+layout(push_constant) uniform PushModel {
+	mat4 model;
+} pushModel;
+
+layout(location = 0) out vec3 fragCol;
+layout(location = 1) out vec2 fragTex;
+
+void main() {
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * pushModel.model * vec4(pos.xyz, 1.0);
+	
+	fragCol = vec3(1.0, 1.0, 1.0);
+	fragTex = tex;
+}
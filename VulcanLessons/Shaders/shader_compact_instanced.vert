@@ -0,0 +1,28 @@
+#version 450 		// Use GLSL 4.5
+
+// CompactVertex: no colour, position is 0..1 inside the mesh bounds
+layout(location = 0) in vec4 pos;
+layout(location = 2) in vec2 tex;
+
+// Mesh transform from the transform buffer, one per instance (draws start at their mesh's slot)
+layout(location = 3) in mat4 model;
+
+layout(set = 0, binding = 0) uniform UboViewProjection {
+	mat4 projection;
+	mat4 view;
+} uboViewProjection;
+
+// Mesh's dequantize matrix (bounds scale + offset), fixed for the mesh
+layout(push_constant) uniform PushDequantize {
+	mat4 dequantize;
+} pushDequantize;
+
+layout(location = 0) out vec3 fragCol;
+layout(location = 1) out vec2 fragTex;
+
+void main() {
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * model * pushDequantize.dequantize * vec4(pos.xyz, 1.0);
+	
+	fragCol = vec3(1.0, 1.0, 1.0);
+	fragTex = tex;
+}
@@ -0,0 +1,23 @@
+#version 450 		// Use GLSL 4.5
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 col;
+layout(location = 2) in vec2 tex;
+
+// Mesh transform from the transform buffer, one per instance (draws start at their mesh's slot)
+layout(location = 3) in mat4 model;
+
+layout(set = 0, binding = 0) uniform UboViewProjection {
+	mat4 projection;
+	mat4 view;
+} uboViewProjection;
+
+layout(location = 0) out vec3 fragCol;
+layout(location = 1) out vec2 fragTex;
+
+void main() {
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * model * vec4(pos, 1.0);
+	
+	fragCol = col;
+	fragTex = tex;
+}
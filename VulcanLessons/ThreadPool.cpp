@@ -0,0 +1,122 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+// Pool and index of the worker the current thread is (null on threads no pool started)
+static thread_local ThreadPool* currentPool = nullptr;
+static thread_local int currentWorkerIndex = -1;
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	}
+
+	for (uint32_t i = 0; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this, static_cast<int>(i));
+	}
+}
+
+void ThreadPool::enqueue(std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		jobs.push_back(std::move(job));
+	}
+	jobAvailable.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& job) {
+	if (count == 0) {
+		return;
+	}
+
+	std::atomic<size_t> nextItem(0);
+	std::atomic<bool> failed(false);
+	std::exception_ptr error;
+
+	// Every runner takes the next free item until none are left, so uneven items balance out
+	auto runItems = [&] {
+		size_t item;
+		while (!failed.load() && (item = nextItem.fetch_add(1)) < count) {
+			try {
+				job(item);
+			}
+			catch (...) {
+				if (!failed.exchange(true)) {
+					error = std::current_exception();
+				}
+			}
+		}
+	};
+
+	// Helpers wait for nothing, so they can't deadlock even if all workers are busy (caller does the work then)
+	size_t helperCount = std::min(static_cast<size_t>(workers.size()), count - 1);
+	std::mutex doneMutex;
+	std::condition_variable doneSignal;
+	size_t helpersDone = 0;
+
+	for (size_t i = 0; i < helperCount; i++) {
+		enqueue([&] {
+			runItems();
+
+			std::lock_guard<std::mutex> lock(doneMutex);
+			helpersDone++;
+			doneSignal.notify_one();
+		});
+	}
+
+	runItems();
+
+	// Helpers reference this stack frame, wait for every one of them (a queued helper finds no items and returns)
+	{
+		std::unique_lock<std::mutex> lock(doneMutex);
+		doneSignal.wait(lock, [&] { return helpersDone == helperCount; });
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+uint32_t ThreadPool::getThreadCount() {
+	return static_cast<uint32_t>(workers.size());
+}
+
+int ThreadPool::getWorkerIndex() {
+	return currentPool == this ? currentWorkerIndex : -1;
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stopping = true;
+		jobs.clear();
+	}
+	jobAvailable.notify_all();
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::workerLoop(int workerIndex) {
+	currentPool = this;
+	currentWorkerIndex = workerIndex;
+
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (stopping) {
+				return;
+			}
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		job();
+	}
+}
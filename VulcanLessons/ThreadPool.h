@@ -0,0 +1,41 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads taking jobs from a shared queue
+class ThreadPool {
+public:
+	// 0 = one thread per hardware thread, minus the one the main loop runs on
+	ThreadPool(uint32_t threadCount = 0);
+
+	// Add job to the queue, it runs on the first free worker
+	void enqueue(std::function<void()> job);
+
+	// Run job(i) for every i in [0, count) on the workers and the calling thread, returns once all are done.
+	// The caller takes part, so this is safe to call from inside another pool's job.
+	// First exception thrown by a job is rethrown here (remaining items are skipped).
+	void parallelFor(size_t count, const std::function<void(size_t)>& job);
+
+	uint32_t getThreadCount();
+
+	// Index of this pool's worker running the calling code (0..getThreadCount()-1), -1 on any other thread
+	int getWorkerIndex();
+
+	// Jobs still in the queue are dropped, running jobs are finished before returning
+	~ThreadPool();
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+
+	std::mutex jobMutex;
+	std::condition_variable jobAvailable;
+	bool stopping = false;
+
+	void workerLoop(int workerIndex);
+};
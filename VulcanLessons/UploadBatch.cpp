@@ -0,0 +1,433 @@
+#include "UploadBatch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+#include "Utils.h"
+
+// Staging offsets are kept aligned so any copy (buffer or image texel) can start there
+static const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+// Stages that read uploaded data on the graphics queue
+static const VkPipelineStageFlags UPLOAD_DST_STAGES = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+	| VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+// Ways uploaded buffers are read (vertex/index data, meshlets read by the cull shader)
+static const VkAccessFlags UPLOAD_BUFFER_ACCESS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+// One barrier per contiguous destination range, so meshes packed next to each other in the arena share a barrier
+static std::vector<VkBufferMemoryBarrier> bufferBarriers(const std::vector<VkBufferCopy>& regions, VkBuffer buffer,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess, uint32_t srcFamily, uint32_t dstFamily) {
+	std::vector<VkBufferCopy> sorted = regions;
+	std::sort(sorted.begin(), sorted.end(), [](const VkBufferCopy& a, const VkBufferCopy& b) {
+		return a.dstOffset < b.dstOffset;
+	});
+
+	std::vector<VkBufferMemoryBarrier> barriers;
+	for (auto& region : sorted) {
+		if (!barriers.empty() && barriers.back().offset + barriers.back().size == region.dstOffset) {
+			barriers.back().size += region.size;
+			continue;
+		}
+
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.srcQueueFamilyIndex = srcFamily;
+		barrier.dstQueueFamilyIndex = dstFamily;
+		barrier.buffer = buffer;
+		barrier.offset = region.dstOffset;
+		barrier.size = region.size;
+		barriers.push_back(barrier);
+	}
+
+	return barriers;
+}
+
+static VkImageMemoryBarrier imageBarrier(VkImage image, uint32_t baseMipLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess, uint32_t srcFamily, uint32_t dstFamily) {
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = srcFamily;
+	barrier.dstQueueFamilyIndex = dstFamily;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = baseMipLevel;
+	barrier.subresourceRange.levelCount = levelCount;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	return barrier;
+}
+
+UploadBatch::UploadBatch(UploadContext* newContext, VkDeviceSize newChunkSize) {
+	context = newContext;
+	chunkSize = newChunkSize;
+}
+
+void UploadBatch::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+	if (size == 0) {
+		return;
+	}
+	if (transferCommandBuffer != VK_NULL_HANDLE) {
+		throw std::runtime_error("Can't add to an Upload Batch that was already submitted!");
+	}
+
+	PendingCopy copy = {};
+	copy.dstBuffer = dstBuffer;
+	copy.region.dstOffset = dstOffset;
+	copy.region.size = size;
+	stage(data, size, &copy.srcBuffer, &copy.region.srcOffset);
+
+	copies.push_back(copy);
+	uploadedBytes += size;
+}
+
+void UploadBatch::uploadImage(VkImage dstImage, uint32_t width, uint32_t height, uint32_t mipLevels, bool generateMipmaps,
+	const void* data, VkDeviceSize size) {
+	if (transferCommandBuffer != VK_NULL_HANDLE) {
+		throw std::runtime_error("Can't add to an Upload Batch that was already submitted!");
+	}
+
+	PendingImage image = {};
+	image.dstImage = dstImage;
+	image.width = width;
+	image.height = height;
+	image.mipLevels = mipLevels;
+	image.generateMipmaps = generateMipmaps;
+
+	VkDeviceSize srcOffset;
+	stage(data, size, &image.srcBuffer, &srcOffset);
+
+	// Blitted chains only need level 0 from staging
+	uint32_t uploadLevels = generateMipmaps ? 1 : mipLevels;
+	uint32_t levelWidth = width;
+	uint32_t levelHeight = height;
+	for (uint32_t level = 0; level < uploadLevels; level++) {
+		VkBufferImageCopy region = {};
+		region.bufferOffset = srcOffset;									// Offset into data
+		region.bufferRowLength = 0;											// Data is tightly packed
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = level;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = {0, 0, 0};
+		region.imageExtent = {levelWidth, levelHeight, 1};
+		image.regions.push_back(region);
+
+		srcOffset += static_cast<VkDeviceSize>(levelWidth) * levelHeight * 4;
+		levelWidth = std::max(levelWidth / 2, 1u);
+		levelHeight = std::max(levelHeight / 2, 1u);
+	}
+
+	images.push_back(image);
+	uploadedBytes += size;
+}
+
+void UploadBatch::submit() {
+	if ((copies.empty() && images.empty()) || transferCommandBuffer != VK_NULL_HANDLE) {
+		return;
+	}
+
+	// Same family means no ownership transfer, the copy submit alone makes data ready
+	bool ownershipTransfer = context->transferFamily != context->graphicsFamily;
+
+	// Both queues signal the same timeline, and a value must never be signalled before a smaller one is reached,
+	// so the copies wait on the previous batch's last value (its acquire on the graphics queue may still be running)
+	recordTransfer(ownershipTransfer);
+	uint64_t previousValue = context->timelineValue;
+	uint64_t transferValue = ++context->timelineValue;
+	submitCommandBuffer(context->transferQueue, transferCommandBuffer, previousValue, transferValue);
+	completeValue = transferValue;
+
+	if (ownershipTransfer) {
+		recordAcquire();
+		completeValue = ++context->timelineValue;
+		submitCommandBuffer(context->graphicsQueue, graphicsCommandBuffer, transferValue, completeValue);
+	}
+}
+
+bool UploadBatch::isComplete() {
+	if (transferCommandBuffer == VK_NULL_HANDLE) {
+		return copies.empty() && images.empty();
+	}
+
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(context->device, context->timeline, &value);
+	return value >= completeValue;
+}
+
+void UploadBatch::wait() {
+	if (transferCommandBuffer != VK_NULL_HANDLE) {
+		VkSemaphoreWaitInfo waitInfo = {};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &context->timeline;
+		waitInfo.pValues = &completeValue;
+
+		vkWaitSemaphores(context->device, &waitInfo, std::numeric_limits<uint64_t>::max());
+	}
+	release();
+}
+
+uint64_t UploadBatch::getCompleteValue() {
+	return completeValue;
+}
+
+VkDeviceSize UploadBatch::getUploadedBytes() {
+	return uploadedBytes;
+}
+
+UploadBatch::~UploadBatch() = default;
+
+void UploadBatch::stage(const void* data, VkDeviceSize size, VkBuffer* srcBuffer, VkDeviceSize* srcOffset) {
+	// Pack into the last chunk if there is room, otherwise start a new one
+	StagingChunk* chunk = chunks.empty() ? nullptr : &chunks.back();
+	VkDeviceSize offset = 0;
+	if (chunk) {
+		offset = (chunk->used + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+	}
+
+	if (!chunk || offset + size > chunk->size) {
+		StagingChunk newChunk;
+		newChunk.size = std::max(chunkSize, size);
+		UTILS::createBuffer(context->device, context->allocator, newChunk.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		                    &newChunk.buffer, &newChunk.memory);
+		chunks.push_back(newChunk);
+		chunk = &chunks.back();
+		offset = 0;
+	}
+
+	// Staging memory is persistently mapped, so data is copied out of the caller's memory right away
+	memcpy(static_cast<char*>(chunk->memory.mapped) + offset, data, (size_t)size);
+	chunk->used = offset + size;
+
+	*srcBuffer = chunk->buffer;
+	*srcOffset = offset;
+}
+
+void UploadBatch::recordTransfer(bool ownershipTransfer) {
+	VkDevice device = context->device;
+	transferCommandBuffer = UTILS::beginCommandBuffer(device, context->transferCommandPool);
+
+	// New images need TRANSFER_DST layout before they can be copied to
+	if (!images.empty()) {
+		std::vector<VkImageMemoryBarrier> toTransfer;
+		for (auto& image : images) {
+			toTransfer.push_back(imageBarrier(image.dstImage, 0, image.mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED));
+		}
+		vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+	}
+
+	// Group regions by src/dst pair so each pair is a single vkCmdCopyBuffer
+	std::map<std::pair<VkBuffer, VkBuffer>, std::vector<VkBufferCopy>> regions;
+	std::map<VkBuffer, std::vector<VkBufferCopy>> dstRegions;
+	for (auto& copy : copies) {
+		regions[{copy.srcBuffer, copy.dstBuffer}].push_back(copy.region);
+		dstRegions[copy.dstBuffer].push_back(copy.region);
+	}
+	for (auto& group : regions) {
+		vkCmdCopyBuffer(transferCommandBuffer, group.first.first, group.first.second,
+			static_cast<uint32_t>(group.second.size()), group.second.data());
+	}
+	for (auto& image : images) {
+		vkCmdCopyBufferToImage(transferCommandBuffer, image.srcBuffer, image.dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(image.regions.size()), image.regions.data());
+	}
+
+	// Release to graphics family (dst access is ignored for a release), or make writes visible when on the same family
+	uint32_t srcFamily = ownershipTransfer ? context->transferFamily : VK_QUEUE_FAMILY_IGNORED;
+	uint32_t dstFamily = ownershipTransfer ? context->graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+	VkAccessFlags bufferDstAccess = ownershipTransfer ? 0 : UPLOAD_BUFFER_ACCESS;
+	VkAccessFlags imageDstAccess = ownershipTransfer ? 0 : VK_ACCESS_SHADER_READ_BIT;
+	VkPipelineStageFlags dstStage = ownershipTransfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : UPLOAD_DST_STAGES;
+
+	std::vector<VkBufferMemoryBarrier> releaseBuffers;
+	for (auto& dst : dstRegions) {
+		std::vector<VkBufferMemoryBarrier> barriers = bufferBarriers(dst.second, dst.first,
+			VK_ACCESS_TRANSFER_WRITE_BIT, bufferDstAccess, srcFamily, dstFamily);
+		releaseBuffers.insert(releaseBuffers.end(), barriers.begin(), barriers.end());
+	}
+
+	std::vector<VkImageMemoryBarrier> releaseImages;
+	for (auto& image : images) {
+		if (!image.generateMipmaps) {
+			releaseImages.push_back(imageBarrier(image.dstImage, 0, image.mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, imageDstAccess, srcFamily, dstFamily));
+		}
+		else if (ownershipTransfer) {
+			// Blits need a graphics queue, so image goes over in TRANSFER_DST layout and the chain is built after acquire
+			releaseImages.push_back(imageBarrier(image.dstImage, 0, image.mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, 0, srcFamily, dstFamily));
+		}
+	}
+
+	vkCmdPipelineBarrier(transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+		0, nullptr,
+		static_cast<uint32_t>(releaseBuffers.size()), releaseBuffers.data(),
+		static_cast<uint32_t>(releaseImages.size()), releaseImages.data());
+
+	// Same family means this queue can blit, so build mip chains right here
+	if (!ownershipTransfer) {
+		for (auto& image : images) {
+			if (image.generateMipmaps) {
+				recordMipmaps(transferCommandBuffer, image);
+			}
+		}
+	}
+
+	vkEndCommandBuffer(transferCommandBuffer);
+}
+
+void UploadBatch::recordAcquire() {
+	graphicsCommandBuffer = UTILS::beginCommandBuffer(context->device, context->graphicsCommandPool);
+
+	// Acquire must match the release exactly (same ranges, same layouts)
+	std::map<VkBuffer, std::vector<VkBufferCopy>> dstRegions;
+	for (auto& copy : copies) {
+		dstRegions[copy.dstBuffer].push_back(copy.region);
+	}
+
+	std::vector<VkBufferMemoryBarrier> acquireBuffers;
+	for (auto& dst : dstRegions) {
+		std::vector<VkBufferMemoryBarrier> barriers = bufferBarriers(dst.second, dst.first,
+			0, UPLOAD_BUFFER_ACCESS, context->transferFamily, context->graphicsFamily);
+		acquireBuffers.insert(acquireBuffers.end(), barriers.begin(), barriers.end());
+	}
+
+	std::vector<VkImageMemoryBarrier> acquireImages;
+	for (auto& image : images) {
+		if (image.generateMipmaps) {
+			acquireImages.push_back(imageBarrier(image.dstImage, 0, image.mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				0, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, context->transferFamily, context->graphicsFamily));
+		}
+		else {
+			acquireImages.push_back(imageBarrier(image.dstImage, 0, image.mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				0, VK_ACCESS_SHADER_READ_BIT, context->transferFamily, context->graphicsFamily));
+		}
+	}
+
+	// Submit waits on the transfer value at ALL_COMMANDS, so the barrier chains after it
+	vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, UPLOAD_DST_STAGES | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		static_cast<uint32_t>(acquireBuffers.size()), acquireBuffers.data(),
+		static_cast<uint32_t>(acquireImages.size()), acquireImages.data());
+
+	for (auto& image : images) {
+		if (image.generateMipmaps) {
+			recordMipmaps(graphicsCommandBuffer, image);
+		}
+	}
+
+	vkEndCommandBuffer(graphicsCommandBuffer);
+}
+
+void UploadBatch::recordMipmaps(VkCommandBuffer commandBuffer, const PendingImage& image) {
+	// Every level starts in TRANSFER_DST, level 0 holds the uploaded pixels
+	int32_t mipWidth = static_cast<int32_t>(image.width);
+	int32_t mipHeight = static_cast<int32_t>(image.height);
+
+	for (uint32_t level = 1; level < image.mipLevels; level++) {
+		// Previous level becomes blit source
+		VkImageMemoryBarrier toSrc = imageBarrier(image.dstImage, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &toSrc);
+
+		int32_t nextWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+		int32_t nextHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+
+		// Linear filtered downscale of previous level into this one
+		VkImageBlit blit = {};
+		blit.srcOffsets[0] = {0, 0, 0};
+		blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = level - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = {0, 0, 0};
+		blit.dstOffsets[1] = {nextWidth, nextHeight, 1};
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = level;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+
+		vkCmdBlitImage(commandBuffer,
+			image.dstImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			image.dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+
+		// Previous level is finished, hand it to shaders
+		VkImageMemoryBarrier toShader = imageBarrier(image.dstImage, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &toShader);
+
+		mipWidth = nextWidth;
+		mipHeight = nextHeight;
+	}
+
+	// Last level was only ever written to
+	VkImageMemoryBarrier lastToShader = imageBarrier(image.dstImage, image.mipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &lastToShader);
+}
+
+void UploadBatch::submitCommandBuffer(VkQueue queue, VkCommandBuffer commandBuffer, uint64_t waitValue, uint64_t signalValue) {
+	// Timeline values ride along in the pNext chain
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = waitValue > 0 ? 1 : 0;
+	timelineInfo.pWaitSemaphoreValues = &waitValue;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = waitValue > 0 ? 1 : 0;
+	submitInfo.pWaitSemaphores = &context->timeline;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &context->timeline;
+
+	VkResult result = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit an Upload Batch!");
+	}
+}
+
+void UploadBatch::release() {
+	if (transferCommandBuffer != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(context->device, context->transferCommandPool, 1, &transferCommandBuffer);
+		transferCommandBuffer = VK_NULL_HANDLE;
+	}
+	if (graphicsCommandBuffer != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(context->device, context->graphicsCommandPool, 1, &graphicsCommandBuffer);
+		graphicsCommandBuffer = VK_NULL_HANDLE;
+	}
+
+	for (auto& chunk : chunks) {
+		vkDestroyBuffer(context->device, chunk.buffer, nullptr);
+		context->allocator->free(chunk.memory);
+	}
+	chunks.clear();
+	copies.clear();
+	images.clear();
+}
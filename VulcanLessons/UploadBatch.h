@@ -0,0 +1,102 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "MemoryAllocator.h"
+
+// Size of each host visible staging buffer the batch packs data into (bigger uploads get their own buffer)
+const VkDeviceSize UPLOAD_CHUNK_SIZE = 16 * 1024 * 1024;
+
+// Queues and timeline semaphore shared by every UploadBatch
+struct UploadContext {
+	VkDevice device;
+	MemoryAllocator* allocator;
+
+	VkQueue transferQueue;					// Copies run here (dedicated transfer family if the GPU has one)
+	VkCommandPool transferCommandPool;
+	uint32_t transferFamily;
+
+	VkQueue graphicsQueue;					// Resources are handed over to this family before first use
+	VkCommandPool graphicsCommandPool;
+	uint32_t graphicsFamily;
+
+	VkSemaphore timeline;					// Timeline semaphore signalled by upload submits
+	uint64_t timelineValue = 0;				// Last value handed out to a submit
+};
+
+// Collects many uploads and sends them to the GPU with a single transfer submit.
+// Data is copied to staging memory straight away, commands are only recorded on submit().
+// If the transfer queue is from another family, ownership is released on the transfer queue and acquired on the
+// graphics queue, and the acquire waits on the timeline value signalled by the copies.
+// Batches complete in submit order, each one's copies wait until the previous batch is complete.
+class UploadBatch {
+public:
+	UploadBatch(UploadContext* newContext, VkDeviceSize newChunkSize = UPLOAD_CHUNK_SIZE);
+
+	// Stage size bytes of data to be copied to dstBuffer at dstOffset (read as vertex/index/storage data afterwards)
+	void uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+	// Stage tightly packed RGBA8 pixels for a new image, which ends up in SHADER_READ_ONLY_OPTIMAL layout (all mip levels).
+	// generateMipmaps = data is level 0 only and the rest is blitted on the GPU (needs linear blit support for the format),
+	// otherwise data holds every level one after another.
+	void uploadImage(VkImage dstImage, uint32_t width, uint32_t height, uint32_t mipLevels, bool generateMipmaps,
+		const void* data, VkDeviceSize size);
+
+	// Record and submit all work (does not wait)
+	void submit();
+	// Check timeline without blocking
+	bool isComplete();
+	// Block until the batch finished on GPU, then release staging memory and command buffers
+	void wait();
+
+	// Timeline value reached once everything in the batch can be used by the graphics queue
+	uint64_t getCompleteValue();
+	VkDeviceSize getUploadedBytes();
+
+	~UploadBatch();
+
+private:
+	struct StagingChunk {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		MemoryAllocation memory;
+		VkDeviceSize used = 0;
+		VkDeviceSize size = 0;
+	};
+
+	struct PendingCopy {
+		VkBuffer srcBuffer;
+		VkBuffer dstBuffer;
+		VkBufferCopy region;
+	};
+
+	struct PendingImage {
+		VkBuffer srcBuffer;
+		VkImage dstImage;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+		bool generateMipmaps;
+		std::vector<VkBufferImageCopy> regions;		// One per level uploaded from staging
+	};
+
+	UploadContext* context;
+	VkDeviceSize chunkSize;
+
+	std::vector<StagingChunk> chunks;
+	std::vector<PendingCopy> copies;
+	std::vector<PendingImage> images;
+	VkDeviceSize uploadedBytes = 0;
+
+	VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+	VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+	uint64_t completeValue = 0;
+
+	void stage(const void* data, VkDeviceSize size, VkBuffer* srcBuffer, VkDeviceSize* srcOffset);
+	void recordTransfer(bool ownershipTransfer);
+	void recordAcquire();
+	void recordMipmaps(VkCommandBuffer commandBuffer, const PendingImage& image);
+	void submitCommandBuffer(VkQueue queue, VkCommandBuffer commandBuffer, uint64_t waitValue, uint64_t signalValue);
+	void release();
+};
@@ -0,0 +1,254 @@
+#include "VertexConvert.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "CpuFeatures.h"
+
+// Kernels write straight into the interleaved layout: pos(3) col(3) tex(2) = 2 x 4 floats
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex layout changed, update conversion kernels!");
+static_assert(offsetof(Vertex, col) == 3 * sizeof(float), "Vertex layout changed, update conversion kernels!");
+static_assert(offsetof(Vertex, tex) == 6 * sizeof(float), "Vertex layout changed, update conversion kernels!");
+static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "Unexpected aiVector3D size!");
+
+static void convertScalar(const aiVector3D* positions, const aiVector3D* texCoords, size_t count, Vertex* vertices) {
+	// UV check done once, not per vertex
+	if (texCoords) {
+		for (size_t i = 0; i < count; i++) {
+			float* out = reinterpret_cast<float*>(vertices + i);
+			out[0] = positions[i].x; out[1] = positions[i].y; out[2] = positions[i].z;
+			out[3] = 1.0f; out[4] = 1.0f; out[5] = 1.0f;
+			out[6] = texCoords[i].x; out[7] = texCoords[i].y;
+		}
+	}
+	else {
+		for (size_t i = 0; i < count; i++) {
+			float* out = reinterpret_cast<float*>(vertices + i);
+			out[0] = positions[i].x; out[1] = positions[i].y; out[2] = positions[i].z;
+			out[3] = 1.0f; out[4] = 1.0f; out[5] = 1.0f;
+			out[6] = 0.0f; out[7] = 0.0f;
+		}
+	}
+}
+
+#ifdef SIMD_X86
+// Both SIMD kernels build 4 vertices per step, each as two 4 float halves:
+// low  = x y z 1 (pos + red)
+// high = 1 1 u v (green, blue + tex)
+// 4 positions/UVs are read as three 4 float loads (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3)
+template<bool HAS_TEX>
+static inline void buildBlock(const float* pos, const float* tex, __m128* low, __m128* high) {
+	const __m128 ones = _mm_set1_ps(1.0f);
+	const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	const __m128 oneW = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+	__m128 a = _mm_loadu_ps(pos);
+	__m128 b = _mm_loadu_ps(pos + 4);
+	__m128 c = _mm_loadu_ps(pos + 8);
+
+	__m128 p1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 3, 3));		// x1 x1 y1 z1
+	low[0] = a;
+	low[1] = _mm_shuffle_ps(p1, p1, _MM_SHUFFLE(3, 3, 2, 1));
+	low[2] = _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 0, 3, 2));
+	low[3] = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 2, 1));
+	low[0] = _mm_or_ps(_mm_and_ps(low[0], xyzMask), oneW);
+	low[1] = _mm_or_ps(_mm_and_ps(low[1], xyzMask), oneW);
+	low[2] = _mm_or_ps(_mm_and_ps(low[2], xyzMask), oneW);
+	low[3] = _mm_or_ps(_mm_and_ps(low[3], xyzMask), oneW);
+
+	if (HAS_TEX) {
+		__m128 ta = _mm_loadu_ps(tex);
+		__m128 tb = _mm_loadu_ps(tex + 4);
+		__m128 tc = _mm_loadu_ps(tex + 8);
+
+		__m128 uv1 = _mm_shuffle_ps(ta, tb, _MM_SHUFFLE(0, 0, 3, 3));	// u1 u1 v1 v1
+		high[0] = _mm_shuffle_ps(ones, ta, _MM_SHUFFLE(1, 0, 0, 0));
+		high[1] = _mm_shuffle_ps(ones, uv1, _MM_SHUFFLE(2, 0, 0, 0));
+		high[2] = _mm_shuffle_ps(ones, tb, _MM_SHUFFLE(3, 2, 0, 0));
+		high[3] = _mm_shuffle_ps(ones, tc, _MM_SHUFFLE(2, 1, 0, 0));
+	}
+	else {
+		high[0] = high[1] = high[2] = high[3] = _mm_set_ps(0.0f, 0.0f, 1.0f, 1.0f);
+	}
+}
+
+template<bool HAS_TEX>
+static void convertBlocksSSE(const float* pos, const float* tex, size_t blockCount, float* out) {
+	for (size_t block = 0; block < blockCount; block++) {
+		__m128 low[4], high[4];
+		buildBlock<HAS_TEX>(pos, tex, low, high);
+
+		// Written out, loops over the registers make compilers spill them to the stack
+		_mm_storeu_ps(out, low[0]);
+		_mm_storeu_ps(out + 4, high[0]);
+		_mm_storeu_ps(out + 8, low[1]);
+		_mm_storeu_ps(out + 12, high[1]);
+		_mm_storeu_ps(out + 16, low[2]);
+		_mm_storeu_ps(out + 20, high[2]);
+		_mm_storeu_ps(out + 24, low[3]);
+		_mm_storeu_ps(out + 28, high[3]);
+
+		pos += 12;
+		tex += HAS_TEX ? 12 : 0;
+		out += 32;
+	}
+}
+
+template<bool HAS_TEX>
+TARGET_AVX
+static void convertBlocksAVX(const float* pos, const float* tex, size_t blockCount, float* out) {
+	for (size_t block = 0; block < blockCount; block++) {
+		__m128 low[4], high[4];
+		buildBlock<HAS_TEX>(pos, tex, low, high);
+
+		// Whole vertex in one store
+		_mm256_storeu_ps(out, _mm256_insertf128_ps(_mm256_castps128_ps256(low[0]), high[0], 1));
+		_mm256_storeu_ps(out + 8, _mm256_insertf128_ps(_mm256_castps128_ps256(low[1]), high[1], 1));
+		_mm256_storeu_ps(out + 16, _mm256_insertf128_ps(_mm256_castps128_ps256(low[2]), high[2], 1));
+		_mm256_storeu_ps(out + 24, _mm256_insertf128_ps(_mm256_castps128_ps256(low[3]), high[3], 1));
+
+		pos += 12;
+		tex += HAS_TEX ? 12 : 0;
+		out += 32;
+	}
+}
+
+static void convertSSE(const aiVector3D* positions, const aiVector3D* texCoords, size_t count, Vertex* vertices) {
+	// UV check picks the loop, not checked per vertex
+	size_t blockCount = count / 4;
+	if (texCoords) {
+		convertBlocksSSE<true>(&positions[0].x, &texCoords[0].x, blockCount, reinterpret_cast<float*>(vertices));
+	}
+	else {
+		convertBlocksSSE<false>(&positions[0].x, nullptr, blockCount, reinterpret_cast<float*>(vertices));
+	}
+
+	// Leftover vertices (block loads would read past the end)
+	size_t done = blockCount * 4;
+	convertScalar(positions + done, texCoords ? texCoords + done : nullptr, count - done, vertices + done);
+}
+
+static void convertAVX(const aiVector3D* positions, const aiVector3D* texCoords, size_t count, Vertex* vertices) {
+	size_t blockCount = count / 4;
+	if (texCoords) {
+		convertBlocksAVX<true>(&positions[0].x, &texCoords[0].x, blockCount, reinterpret_cast<float*>(vertices));
+	}
+	else {
+		convertBlocksAVX<false>(&positions[0].x, nullptr, blockCount, reinterpret_cast<float*>(vertices));
+	}
+
+	size_t done = blockCount * 4;
+	convertScalar(positions + done, texCoords ? texCoords + done : nullptr, count - done, vertices + done);
+}
+#endif
+
+namespace VERTEX_CONVERT {
+
+	VertexKernel getBestKernel() {
+#ifdef SIMD_X86
+		static const VertexKernel best = CPU_FEATURES::hasAVX() ? VertexKernel::AVX : VertexKernel::SSE;
+		return best;
+#else
+		return VertexKernel::Scalar;
+#endif
+	}
+
+	const char* getKernelName(VertexKernel kernel) {
+		switch (kernel) {
+		case VertexKernel::SSE: return "SSE";
+		case VertexKernel::AVX: return "AVX";
+		default: return "Scalar";
+		}
+	}
+
+	void convertVertices(const aiVector3D* positions, const aiVector3D* texCoords, size_t count, Vertex* vertices) {
+		convertVertices(positions, texCoords, count, vertices, getBestKernel());
+	}
+
+	void convertVertices(const aiVector3D* positions, const aiVector3D* texCoords, size_t count, Vertex* vertices, VertexKernel kernel) {
+#ifdef SIMD_X86
+		if (kernel == VertexKernel::AVX && getBestKernel() == VertexKernel::AVX) {
+			convertAVX(positions, texCoords, count, vertices);
+			return;
+		}
+		if (kernel != VertexKernel::Scalar) {
+			convertSSE(positions, texCoords, count, vertices);
+			return;
+		}
+#endif
+		convertScalar(positions, texCoords, count, vertices);
+	}
+
+	// Loop LoadMesh used before the kernels, kept as the benchmark baseline
+	static void convertReference(const aiVector3D* positions, const aiVector3D* texCoords, size_t count, Vertex* vertices) {
+		for (size_t i = 0; i < count; i++) {
+			vertices[i].pos = { positions[i].x, positions[i].y, positions[i].z };
+			if (texCoords) {
+				vertices[i].tex = { texCoords[i].x, texCoords[i].y };
+			}
+			else {
+				vertices[i].tex = { 0.0f, 0.0f };
+			}
+			vertices[i].col = { 1.0f, 1.0f, 1.0f };
+		}
+	}
+
+	void runBenchmark(size_t vertexCount, int iterations) {
+		// Random input, a few vertices over a multiple of 4 so the tail path runs too
+		vertexCount += 3;
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> value(-100.0f, 100.0f);
+		std::vector<aiVector3D> positions(vertexCount);
+		std::vector<aiVector3D> texCoords(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++) {
+			positions[i] = { value(random), value(random), value(random) };
+			texCoords[i] = { value(random), value(random), 0.0f };
+		}
+
+		std::vector<Vertex> expected(vertexCount);
+		std::vector<Vertex> vertices(vertexCount);
+
+		struct Candidate {
+			const char* name;
+			void (*convert)(const aiVector3D*, const aiVector3D*, size_t, Vertex*);
+		};
+		std::vector<Candidate> candidates = {
+			{ "Reference loop", convertReference },
+			{ "Scalar", convertScalar },
+		};
+#ifdef SIMD_X86
+		candidates.push_back({ "SSE", convertSSE });
+		if (getBestKernel() == VertexKernel::AVX) {
+			candidates.push_back({ "AVX", convertAVX });
+		}
+#endif
+
+		std::cout << "Vertex conversion benchmark: " << vertexCount << " vertices, best of " << iterations << " runs" << std::endl;
+		for (auto& candidate : candidates) {
+			for (int withTex = 1; withTex >= 0; withTex--) {
+				const aiVector3D* tex = withTex ? texCoords.data() : nullptr;
+				convertReference(positions.data(), tex, vertexCount, expected.data());
+
+				double bestSeconds = 1e30;
+				for (int i = 0; i < iterations; i++) {
+					auto start = std::chrono::steady_clock::now();
+					candidate.convert(positions.data(), tex, vertexCount, vertices.data());
+					double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+					bestSeconds = std::min(bestSeconds, seconds);
+				}
+
+				// Make sure every kernel still produces exactly the reference output
+				bool correct = memcmp(vertices.data(), expected.data(), sizeof(Vertex) * vertexCount) == 0;
+
+				std::cout << "  " << candidate.name << (withTex ? " (uv)   : " : " (no uv): ")
+					<< vertexCount / bestSeconds / 1e6 << " M vertices/s"
+					<< (correct ? "" : "  MISMATCH!") << std::endl;
+			}
+		}
+	}
+}
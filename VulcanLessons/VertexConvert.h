@@ -0,0 +1,25 @@
+#pragma once
+
+#include <assimp/scene.h>
+
+#include "Mesh.h"
+
+// Code paths of the aiMesh -> Vertex conversion
+enum class VertexKernel {
+	Scalar,			// Plain loop, any CPU
+	SSE,			// 4 vertices per step, 128 bit stores
+	AVX				// 4 vertices per step, one 256 bit store per vertex
+};
+
+namespace VERTEX_CONVERT {
+	// Fastest kernel the running CPU supports (checked once)
+	VertexKernel getBestKernel();
+	const char* getKernelName(VertexKernel kernel);
+
+	// Interleave count positions (+ first UV channel, may be nullptr) into vertices, colour is set to white
+	void convertVertices(const aiVector3D* positions, const aiVector3D* texCoords, size_t count, Vertex* vertices);
+	void convertVertices(const aiVector3D* positions, const aiVector3D* texCoords, size_t count, Vertex* vertices, VertexKernel kernel);
+
+	// Time every kernel against the original per vertex loop and print vertices per second
+	void runBenchmark(size_t vertexCount = 1 << 20, int iterations = 20);
+}
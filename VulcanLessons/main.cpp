@@ -6,9 +6,11 @@
 #include <glm/glm.hpp>
 #include <glm/mat4x4.hpp>
 
+#include <cstring>
 #include <iostream>
 
 #include "render.h"
+#include "VertexConvert.h"
 
 GLFWwindow* win = nullptr;
 std::unique_ptr<VKRENDER::Render> render;
@@ -23,7 +25,15 @@ void init(std::string title="TEST", int w=1366, int h=768) {
 
 }
 
-int main() {
+int main(int argc, char** argv) {
+	// --bench-vertex: only time the model vertex conversion kernels, no window
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bench-vertex") == 0) {
+			VERTEX_CONVERT::runBenchmark();
+			return 0;
+		}
+	}
+
 	init();
 	//unsigned extCount = 0;
 	//vkEnumerateInstanceExtensionProperties(nullptr, &extCount, nullptr);
@@ -34,7 +44,8 @@ int main() {
 	float deltaTime = 0.0f;
 	float lastTime = 0.0f;
 
-	int modelId = render->createMeshModel("Models/cottage_obj.obj");
+	// Model shows up once loaded, main loop keeps running meanwhile
+	int modelId = render->createMeshModelAsync("Models/cottage_obj.obj");
 	
 	while(!glfwWindowShouldClose(win)) {
 		glfwPollEvents();
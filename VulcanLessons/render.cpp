@@ -1,11 +1,20 @@
 #include "render.h"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <ostream>
 #include <set>
 
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 #include "Utils.h"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -28,13 +37,72 @@ stbi_uc* loadTextureFile(std::string fileName, int* width, int* height, VkDevice
 	return image;
 }
 
+// Fallback when the GPU can't linearly blit the texture format: 2x2 box filter on the CPU.
+// Returns every level packed one after another, level 0 first.
+std::vector<stbi_uc> buildMipChain(const stbi_uc* pixels, uint32_t width, uint32_t height, uint32_t mipLevels) {
+	// Size of all levels together
+	size_t chainSize = 0;
+	for (uint32_t level = 0, w = width, h = height; level < mipLevels; level++) {
+		chainSize += static_cast<size_t>(w) * h * 4;
+		w = std::max(w / 2, 1u);
+		h = std::max(h / 2, 1u);
+	}
+
+	std::vector<stbi_uc> chain(chainSize);
+	memcpy(chain.data(), pixels, static_cast<size_t>(width) * height * 4);
+
+	size_t srcOffset = 0;
+	size_t dstOffset = static_cast<size_t>(width) * height * 4;
+	uint32_t srcWidth = width;
+	uint32_t srcHeight = height;
+	for (uint32_t level = 1; level < mipLevels; level++) {
+		uint32_t dstWidth = std::max(srcWidth / 2, 1u);
+		uint32_t dstHeight = std::max(srcHeight / 2, 1u);
+
+		const stbi_uc* src = chain.data() + srcOffset;
+		stbi_uc* dst = chain.data() + dstOffset;
+		for (uint32_t y = 0; y < dstHeight; y++) {
+			// Clamp so odd sizes (and 1 pixel wide levels) reuse the edge texel
+			uint32_t y0 = std::min(y * 2, srcHeight - 1);
+			uint32_t y1 = std::min(y * 2 + 1, srcHeight - 1);
+			for (uint32_t x = 0; x < dstWidth; x++) {
+				uint32_t x0 = std::min(x * 2, srcWidth - 1);
+				uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1);
+				for (uint32_t c = 0; c < 4; c++) {
+					uint32_t sum = src[(y0 * srcWidth + x0) * 4 + c] + src[(y0 * srcWidth + x1) * 4 + c]
+						+ src[(y1 * srcWidth + x0) * 4 + c] + src[(y1 * srcWidth + x1) * 4 + c];
+					dst[(y * dstWidth + x) * 4 + c] = static_cast<stbi_uc>((sum + 2) / 4);
+				}
+			}
+		}
+
+		srcOffset = dstOffset;
+		dstOffset += static_cast<size_t>(dstWidth) * dstHeight * 4;
+		srcWidth = dstWidth;
+		srcHeight = dstHeight;
+	}
+
+	return chain;
+}
+
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 using namespace VKRENDER;
 
-Render::Render(GLFWwindow* win) : win(win) {
+static_assert(MAX_DRAW_TRANSFORMS <= (1u << DRAW_KEY_DRAW_BITS), "Draw indices don't fit in the draw sort key!");
+
+// Largest axis scale of a transform, bounding spheres and errors scaled by it stay conservative
+static float getMaxScale(const glm::mat4& transform) {
+	return std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+}
+
+Render::Render(GLFWwindow* win, RenderOptions options) :
+	textureDecodeThreads(options.textureDecodeThreads), logModelLoads(options.logModelLoads), recordThreads(options.recordThreads),
+	recordChunkMeshes(std::max(options.recordChunkMeshes, 1u)), win(win), reuseCommandBuffers(options.reuseCommandBuffers),
+	indirectDraws(options.indirectDraws), gpuFrustumCulling(options.gpuFrustumCulling), cpuFrustumCulling(options.cpuFrustumCulling),
+	occlusionCulling(options.occlusionCulling) {
 	init();
 }
 
@@ -49,6 +117,8 @@ void Render::init() {
 		createSurface();
 		getPhysicalDevice();
 		createLogicalDevice();
+		createMemoryAllocator();
+		createGeometryArena();
 
 		createSwapChain();
 		createRenderPass();
@@ -56,6 +126,9 @@ void Render::init() {
 
 		createPushConstantRange();
 		createGraphicsPipeline();
+		createCullPipeline();
+		createDrawCullPipeline();
+		createDepthPyramidPipeline();
 
 		createDepthBufferImage();
 
@@ -64,18 +137,27 @@ void Render::init() {
 
 		createCommandPool();
 		createCommandBuffers();
+		createRecordContexts();
 
 		createTextureSampler();
 		createUniformBuffers();
+		createTransformBuffers();
 
 		createDescriptorPool();
 		createDescriptorSets();
+		createCullResources();
+		createDepthPyramid();
+		createDrawCullResources();
 
 		//second shader
 		createInputDescriptorSets();
 		
 		createSynchronisation();
-		uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
+		createUploadContext();
+		loadPool = std::make_unique<ThreadPool>();
+		decodePool = std::make_unique<ThreadPool>(textureDecodeThreads);
+		uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height,
+			CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
 		uboViewProjection.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
 		uboViewProjection.projection[1][1] *= -1;
@@ -134,7 +216,7 @@ void Render::createInstance() {
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);		// Custom version of the application
 	appInfo.pEngineName = "No Engine";							// Custom engine name
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);			// Custom engine version
-	appInfo.apiVersion = VK_API_VERSION_1_0;					// The Vulkan Version
+	appInfo.apiVersion = VK_API_VERSION_1_2;					// The Vulkan Version (1.2 for timeline semaphores)
 
 	// Creation information for a VkInstance (Vulkan Instance)
 	VkInstanceCreateInfo createInfo = {};
@@ -203,6 +285,15 @@ bool Render::checkInstanceExtensionSupport(std::vector<const char*>& checkExtens
 }
 
 void Render::clean() {
+	// Stop loader threads first (running loads finish), then drop whatever never reached the GPU
+	loadPool.reset();
+	decodePool.reset();
+	recordPool.reset();
+	for (auto& load : modelLoads) {
+		destroyModelLoad(load.get());
+	}
+	modelLoads.clear();
+
 	// Wait until no actions being run on device before destroying
 	vkDeviceWaitIdle(mainDevice.logicalDevice);
 
@@ -217,44 +308,92 @@ void Render::clean() {
 	for (size_t i = 0; i < textureImages.size(); i++) {
 		vkDestroyImageView(mainDevice.logicalDevice, textureImageViews[i], nullptr);
 		vkDestroyImage(mainDevice.logicalDevice, textureImages[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, textureImageMemory[i], nullptr);
-	}
-
-	
-	for (size_t i = 0; i < textureImages.size(); i++) {
-		vkDestroyImageView(mainDevice.logicalDevice, textureImageViews[i], nullptr);
-		vkDestroyImage(mainDevice.logicalDevice, textureImages[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, textureImageMemory[i], nullptr);
+		memoryAllocator->free(textureImageMemory[i]);
 	}
 
 	for (size_t i = 0; i < depthBufferImage.size(); i++) {
 		vkDestroyImageView(mainDevice.logicalDevice, depthBufferImageView[i], nullptr);
 		vkDestroyImage(mainDevice.logicalDevice, depthBufferImage[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, depthBufferImageMemory[i], nullptr);
+		memoryAllocator->free(depthBufferImageMemory[i]);
 	}
 
 	for (size_t i = 0; i < colourBufferImage.size(); i++) {
 		vkDestroyImageView(mainDevice.logicalDevice, colourBufferImageView[i], nullptr);
 		vkDestroyImage(mainDevice.logicalDevice, colourBufferImage[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, colourBufferImageMemory[i], nullptr);
+		memoryAllocator->free(colourBufferImageMemory[i]);
 	}
 	
 	vkDestroyDescriptorPool(mainDevice.logicalDevice, descriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, descriptorSetLayout, nullptr);
+
+	vkDestroyDescriptorPool(mainDevice.logicalDevice, cullDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, cullSetLayout, nullptr);
+	for (size_t i = 0; i < cullFrameBuffer.size(); i++) {
+		vkDestroyBuffer(mainDevice.logicalDevice, cullFrameBuffer[i], nullptr);
+		memoryAllocator->free(cullFrameBufferMemory[i]);
+	}
+	for (size_t i = 0; i < meshletDrawBuffer.size(); i++) {
+		vkDestroyBuffer(mainDevice.logicalDevice, meshletDrawBuffer[i], nullptr);
+		memoryAllocator->free(meshletDrawBufferMemory[i]);
+		vkDestroyBuffer(mainDevice.logicalDevice, meshletCountBuffer[i], nullptr);
+		memoryAllocator->free(meshletCountBufferMemory[i]);
+	}
+	vkDestroyDescriptorPool(mainDevice.logicalDevice, drawCullDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, drawCullSetLayout, nullptr);
+	for (size_t i = 0; i < drawCullInfoBuffer.size(); i++) {
+		vkDestroyBuffer(mainDevice.logicalDevice, drawCullInfoBuffer[i], nullptr);
+		memoryAllocator->free(drawCullInfoBufferMemory[i]);
+		vkDestroyBuffer(mainDevice.logicalDevice, culledDrawBuffer[i], nullptr);
+		memoryAllocator->free(culledDrawBufferMemory[i]);
+		vkDestroyBuffer(mainDevice.logicalDevice, culledCountBuffer[i], nullptr);
+		memoryAllocator->free(culledCountBufferMemory[i]);
+		vkDestroyBuffer(mainDevice.logicalDevice, cullStatsBuffer[i], nullptr);
+		memoryAllocator->free(cullStatsBufferMemory[i]);
+		vkDestroyBuffer(mainDevice.logicalDevice, occludedDrawBuffer[i], nullptr);
+		memoryAllocator->free(occludedDrawBufferMemory[i]);
+	}
+	vkDestroyDescriptorPool(mainDevice.logicalDevice, depthPyramidDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, depthPyramidSetLayout, nullptr);
+	if (depthPyramidImage != VK_NULL_HANDLE) {
+		vkDestroySampler(mainDevice.logicalDevice, depthPyramidSampler, nullptr);
+		for (auto levelView : depthPyramidLevelViews) {
+			vkDestroyImageView(mainDevice.logicalDevice, levelView, nullptr);
+		}
+		vkDestroyImageView(mainDevice.logicalDevice, depthPyramidImageView, nullptr);
+		vkDestroyImage(mainDevice.logicalDevice, depthPyramidImage, nullptr);
+		memoryAllocator->free(depthPyramidImageMemory);
+	}
+	for (size_t i = 0; i < indirectDrawBuffer.size(); i++) {
+		vkDestroyBuffer(mainDevice.logicalDevice, indirectDrawBuffer[i], nullptr);
+		memoryAllocator->free(indirectDrawBufferMemory[i]);
+	}
 	for (size_t i = 0; i < swapChainImages.size(); i++) {
 		vkDestroyBuffer(mainDevice.logicalDevice, vpUniformBuffer[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, vpUniformBufferMemory[i], nullptr);
+		memoryAllocator->free(vpUniformBufferMemory[i]);
+		vkDestroyBuffer(mainDevice.logicalDevice, transformBuffer[i], nullptr);
+		memoryAllocator->free(transformBufferMemory[i]);
 		//vkDestroyBuffer(mainDevice.logicalDevice, modelDUniformBuffer[i], nullptr);
 		//vkFreeMemory(mainDevice.logicalDevice, modelDUniformBufferMemory[i], nullptr);
 	}
 	for (size_t i = 0; i < meshList.size(); i++) {
 		meshList[i].destroyMeshModel();
 	}
+	geometryArena->destroy();
+	// All pooled resources are gone, so blocks can go back to the driver
+	memoryAllocator->destroy();
 	for (size_t i = 0; i < MAX_FRAME_DRAWS; i++) {
 		vkDestroySemaphore(mainDevice.logicalDevice, renderFinished[i], nullptr);
 		vkDestroySemaphore(mainDevice.logicalDevice, imageAvailable[i], nullptr);
 		vkDestroyFence(mainDevice.logicalDevice, drawFences[i], nullptr);
 	}
+	vkDestroySemaphore(mainDevice.logicalDevice, uploadContext.timeline, nullptr);
+	// Destroying a pool frees the secondary buffers allocated from it
+	for (auto& imageContexts : recordContexts) {
+		for (auto& context : imageContexts) {
+			vkDestroyCommandPool(mainDevice.logicalDevice, context.commandPool, nullptr);
+		}
+	}
+	vkDestroyCommandPool(mainDevice.logicalDevice, transferCommandPool, nullptr);
 	vkDestroyCommandPool(mainDevice.logicalDevice, graphicsCommandPool, nullptr);
 	for (auto framebuffer : swapChainFramebuffers) {
 		vkDestroyFramebuffer(mainDevice.logicalDevice, framebuffer, nullptr);
@@ -263,9 +402,23 @@ void Render::clean() {
 	vkDestroyPipeline(mainDevice.logicalDevice, secondPipeline, nullptr);
 	vkDestroyPipelineLayout(mainDevice.logicalDevice, secondPipelineLayout, nullptr);
 
+	vkDestroyPipeline(mainDevice.logicalDevice, cullPipeline, nullptr);
+	vkDestroyPipelineLayout(mainDevice.logicalDevice, cullPipelineLayout, nullptr);
+
+	vkDestroyPipeline(mainDevice.logicalDevice, drawCullPipeline, nullptr);
+	vkDestroyPipelineLayout(mainDevice.logicalDevice, drawCullPipelineLayout, nullptr);
+
+	vkDestroyPipeline(mainDevice.logicalDevice, depthPyramidPipeline, nullptr);
+	vkDestroyPipelineLayout(mainDevice.logicalDevice, depthPyramidPipelineLayout, nullptr);
+
+	vkDestroyPipeline(mainDevice.logicalDevice, compactInstancedPipeline, nullptr);
+	vkDestroyPipeline(mainDevice.logicalDevice, instancedPipeline, nullptr);
+	vkDestroyPipeline(mainDevice.logicalDevice, compactPipeline, nullptr);
 	vkDestroyPipeline(mainDevice.logicalDevice, graphicsPipeline, nullptr);
 	vkDestroyPipelineLayout(mainDevice.logicalDevice, pipelineLayout, nullptr);
 
+	vkDestroyRenderPass(mainDevice.logicalDevice, lateRenderPass, nullptr);
+	vkDestroyRenderPass(mainDevice.logicalDevice, earlyRenderPass, nullptr);
 	vkDestroyRenderPass(mainDevice.logicalDevice, renderPass, nullptr);
 
 	for (auto image : swapChainImages) {
@@ -313,6 +466,14 @@ bool Render::checkDeviceSuitable(VkPhysicalDevice device) {
 	VkPhysicalDeviceFeatures deviceFeatures;
 	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
 
+	// Uploads are gated by a timeline semaphore, which is a Vulkan 1.2 feature
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 deviceFeatures2 = {};
+	deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures2.pNext = &vulkan12Features;
+	vkGetPhysicalDeviceFeatures2(device, &deviceFeatures2);
+
 	QueueFamilyIndices indices = getQueueFamilies(device);
 
 	bool extensionsSupported = checkDeviceExtensionSupport(device);
@@ -323,7 +484,8 @@ bool Render::checkDeviceSuitable(VkPhysicalDevice device) {
 		swapChainValid = !swapChainDetails.presentationModes.empty() && !swapChainDetails.formats.empty();
 	}
 
-	return indices.isValid() && extensionsSupported && swapChainValid && deviceFeatures.samplerAnisotropy;
+	return indices.isValid() && extensionsSupported && swapChainValid && deviceFeatures.samplerAnisotropy
+		&& vulkan12Features.timelineSemaphore;
 }
 
 bool Render::checkDeviceExtensionSupport(VkPhysicalDevice device) {
@@ -373,7 +535,7 @@ QueueFamilyIndices Render::getQueueFamilies(VkPhysicalDevice device) {
 	for (const auto& queueFamily : queueFamilyList) {
 		// First check if queue family has at least 1 queue in that family (could have no queues)
 		// Queue can be multiple types defined through bitfield. Need to bitwise AND with VK_QUEUE_*_BIT to check if has required type
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+		if (indices.graphicsFamily < 0 && queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
 			indices.graphicsFamily = i;		// If queue family is valid, then get index
 		}
 
@@ -381,17 +543,24 @@ QueueFamilyIndices Render::getQueueFamilies(VkPhysicalDevice device) {
 		VkBool32 presentationSupport = false;
 		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
 		// Check if queue is presentation type (can be both graphics and presentation)
-		if (queueFamily.queueCount > 0 && presentationSupport) {
+		if (indices.presentationFamily < 0 && queueFamily.queueCount > 0 && presentationSupport) {
 			indices.presentationFamily = i;
 		}
-		// Check if queue family indices are in a valid state, stop searching if so
-		if (indices.isValid()) {
-			break;
+
+		// Transfer-only family is usually backed by the copy (DMA) engine, so uploads don't take time from rendering
+		if (indices.transferFamily < 0 && queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
+			&& !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			indices.transferFamily = i;
 		}
 
 		i++;
 	}
 
+	// No dedicated transfer family, graphics queues can always do transfers
+	if (indices.transferFamily < 0) {
+		indices.transferFamily = indices.graphicsFamily;
+	}
+
 	return indices;
 }
 
@@ -402,15 +571,15 @@ void Render::createLogicalDevice() {
 
 	// Vector for queue creation information, and set for family indices
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> queueFamilyIndices = {indices.graphicsFamily, indices.presentationFamily};
+	std::set<int> queueFamilyIndices = {indices.graphicsFamily, indices.presentationFamily, indices.transferFamily};
 
 	// Queues the logical device needs to create and info to do so
+	float priority = 1.0f;
 	for (int queueFamilyIndex : queueFamilyIndices) {
 		VkDeviceQueueCreateInfo queueCreateInfo = {};
 		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 		queueCreateInfo.queueFamilyIndex = queueFamilyIndex;						// The index of the family to create a queue from
 		queueCreateInfo.queueCount = 1;												// Number of queues to create
-		float priority = 1.0f;
 		queueCreateInfo.pQueuePriorities = &priority;								// Vulkan needs to know how to handle multiple queues, so decide priority (1 = highest priority)
 
 		queueCreateInfos.push_back(queueCreateInfo);
@@ -428,6 +597,29 @@ void Render::createLogicalDevice() {
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;		// Enable Anisotropy
 
+	// Vulkan 1.2 features are chained through pNext
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.timelineSemaphore = VK_TRUE;	// Enable Timeline Semaphores (upload -> draw handoff)
+	deviceCreateInfo.pNext = &vulkan12Features;
+
+	// Draw counts read from a buffer (meshlet culling) are optional, only enable them where supported
+	VkPhysicalDeviceVulkan12Features supportedVulkan12Features = {};
+	supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+	supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures2.pNext = &supportedVulkan12Features;
+	vkGetPhysicalDeviceFeatures2(mainDevice.physicalDevice, &supportedFeatures2);
+
+	drawIndirectCountSupported = supportedVulkan12Features.drawIndirectCount == VK_TRUE;
+	vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+
+	// Indirect draws starting at an instance other than 0 (transform slot), and many of them per call
+	drawIndirectFirstInstanceSupported = supportedFeatures2.features.drawIndirectFirstInstance == VK_TRUE;
+	multiDrawIndirectSupported = supportedFeatures2.features.multiDrawIndirect == VK_TRUE;
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures2.features.drawIndirectFirstInstance;
+	deviceFeatures.multiDrawIndirect = supportedFeatures2.features.multiDrawIndirect;
+
 	deviceCreateInfo.pEnabledFeatures = &deviceFeatures;			// Physical Device features Logical Device will use
 
 	// Create the logical device for the given physical device
@@ -441,6 +633,30 @@ void Render::createLogicalDevice() {
 	// From given logical device, of given Queue Family, of given Queue Index (0 since only one queue), place reference in given VkQueue
 	vkGetDeviceQueue(mainDevice.logicalDevice, indices.graphicsFamily, 0, &graphicsQueue);
 	vkGetDeviceQueue(mainDevice.logicalDevice, indices.presentationFamily, 0, &presentationQueue);
+	vkGetDeviceQueue(mainDevice.logicalDevice, indices.transferFamily, 0, &transferQueue);
+}
+
+void Render::createMemoryAllocator() {
+	// Buffers and images are sub-allocated from large blocks instead of one vkAllocateMemory each
+	memoryAllocator = std::make_unique<MemoryAllocator>(mainDevice.physicalDevice, mainDevice.logicalDevice);
+}
+
+void Render::createGeometryArena() {
+	// One vertex and one index buffer for every mesh, so they only need binding once per frame
+	geometryArena = std::make_unique<GeometryArena>(memoryAllocator.get(), mainDevice.logicalDevice, MAX_GEOMETRY_VERTICES, MAX_GEOMETRY_INDICES,
+		MAX_GEOMETRY_MESHLETS);
+}
+
+DrawStats Render::getDrawStats() {
+	return drawStats;
+}
+
+CullStats Render::getCullStats() {
+	return cullStats;
+}
+
+MemoryStats Render::getMemoryStats() {
+	return memoryAllocator->getStats();
 }
 
 void Render::createSurface() {
@@ -718,7 +934,7 @@ VkExtent2D Render::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& surfaceCapab
 	}
 }
 
-VkImageView Render::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
+VkImageView Render::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, uint32_t baseMipLevel) {
 	VkImageViewCreateInfo viewCreateInfo = {};
 	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	viewCreateInfo.image = image;											// Image to create view for
@@ -731,8 +947,8 @@ VkImageView Render::createImageView(VkImage image, VkFormat format, VkImageAspec
 
 	// Subresources allow the view to view only a part of an image
 	viewCreateInfo.subresourceRange.aspectMask = aspectFlags;				// Which aspect of image to view (e.g. COLOR_BIT for viewing colour)
-	viewCreateInfo.subresourceRange.baseMipLevel = 0;						// Start mipmap level to view from
-	viewCreateInfo.subresourceRange.levelCount = 1;							// Number of mipmap levels to view
+	viewCreateInfo.subresourceRange.baseMipLevel = baseMipLevel;			// Start mipmap level to view from
+	viewCreateInfo.subresourceRange.levelCount = mipLevels;					// Number of mipmap levels to view
 	viewCreateInfo.subresourceRange.baseArrayLayer = 0;						// Start array level to view from
 	viewCreateInfo.subresourceRange.layerCount = 1;							// Number of array levels to view
 
@@ -838,7 +1054,7 @@ void Render::createRenderPass() {
 	// SUBPASS DEPENDENCIES
 
 	// Need to determine when layout transitions occur using subpass dependencies
-	std::array<VkSubpassDependency, 3> subpassDependencies;
+	std::array<VkSubpassDependency, 5> subpassDependencies;
 
 	// Conversion from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 	// Transition must happen after...
@@ -871,6 +1087,25 @@ void Render::createRenderPass() {
 	subpassDependencies[2].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
 	subpassDependencies[2].dependencyFlags = 0;
 
+	// Depth written by the first subpass is read by the depth pyramid shader after the early pass
+	// (all three passes need the same dependencies to stay compatible, the others have nothing to wait for)
+	subpassDependencies[3].srcSubpass = 0;
+	subpassDependencies[3].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	subpassDependencies[3].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	subpassDependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+	subpassDependencies[3].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	subpassDependencies[3].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	subpassDependencies[3].dependencyFlags = 0;
+
+	// Late pass moves depth back to attachment layout (and writes it), only once the pyramid shader finished reading it
+	subpassDependencies[4].srcSubpass = VK_SUBPASS_EXTERNAL;
+	subpassDependencies[4].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	subpassDependencies[4].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	subpassDependencies[4].dstSubpass = 0;
+	subpassDependencies[4].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	subpassDependencies[4].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	subpassDependencies[4].dependencyFlags = 0;
+
 	std::array<VkAttachmentDescription, 3> renderPassAttachments = {swapchainColourAttachment, colourAttachment, depthAttachment};
 
 	// Create info for Render Pass
@@ -887,6 +1122,40 @@ void Render::createRenderPass() {
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create a Render Pass!");
 	}
+
+	// OCCLUSION CULLING RENDER PASSES
+	// Same attachments and subpasses, only loads, stores and layouts differ (so both stay compatible with renderPass)
+	if (!occlusionCulling) {
+		return;
+	}
+
+	// Early: colour and depth are kept, depth ends up ready for the depth pyramid shader to read.
+	// The swapchain image is only written by the late pass
+	renderPassAttachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	renderPassAttachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	renderPassAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	renderPassAttachments[2].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	renderPassAttachments[2].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	result = vkCreateRenderPass(mainDevice.logicalDevice, &renderPassCreateInfo, nullptr, &earlyRenderPass);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Render Pass!");
+	}
+
+	// Late: colour and depth carry on from the early pass
+	renderPassAttachments[0] = swapchainColourAttachment;
+	renderPassAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	renderPassAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	renderPassAttachments[1].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	renderPassAttachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	renderPassAttachments[2].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	renderPassAttachments[2].initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	renderPassAttachments[2].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	result = vkCreateRenderPass(mainDevice.logicalDevice, &renderPassCreateInfo, nullptr, &lateRenderPass);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Render Pass!");
+	}
 }
 
 void Render::createGraphicsPipeline() {
@@ -1100,6 +1369,158 @@ void Render::createGraphicsPipeline() {
 		throw std::runtime_error("Failed to create a Graphics Pipeline!");
 	}
 
+
+	// CREATE COMPACT VERTEX PIPELINE
+	// Same states, only vertex input and vertex shader change (shader dequantizes with the pushed matrix)
+	std::ifstream compactShaderFile("Shaders/compact_vert.spv");
+	if (compactShaderFile.is_open()) {
+		compactShaderFile.close();
+		auto compactVertexShaderCode = readFile("Shaders/compact_vert.spv");
+		VkShaderModule compactVertexShaderModule = createShaderModule(compactVertexShaderCode);
+
+		VkPipelineShaderStageCreateInfo compactShaderStages [] = {vertexShaderCreateInfo, fragmentShaderCreateInfo};
+		compactShaderStages[0].module = compactVertexShaderModule;
+
+		VkVertexInputBindingDescription compactBindingDescription = bindingDescription;
+		compactBindingDescription.stride = sizeof(CompactVertex);
+
+		// No colour attribute, locations stay the same as the full layout
+		std::array<VkVertexInputAttributeDescription, 2> compactAttributeDescriptions;
+
+		// Position Attribute (0..1 inside the mesh bounds)
+		compactAttributeDescriptions[0].binding = 0;
+		compactAttributeDescriptions[0].location = 0;
+		compactAttributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+		compactAttributeDescriptions[0].offset = offsetof(CompactVertex, pos);
+
+		// Texture Attribute
+		compactAttributeDescriptions[1].binding = 0;
+		compactAttributeDescriptions[1].location = 2;
+		compactAttributeDescriptions[1].format = VK_FORMAT_R16G16_SFLOAT;
+		compactAttributeDescriptions[1].offset = offsetof(CompactVertex, tex);
+
+		VkPipelineVertexInputStateCreateInfo compactVertexInputCreateInfo = vertexInputCreateInfo;
+		compactVertexInputCreateInfo.pVertexBindingDescriptions = &compactBindingDescription;
+		compactVertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(compactAttributeDescriptions.size());
+		compactVertexInputCreateInfo.pVertexAttributeDescriptions = compactAttributeDescriptions.data();
+
+		VkGraphicsPipelineCreateInfo compactPipelineCreateInfo = pipelineCreateInfo;
+		compactPipelineCreateInfo.pStages = compactShaderStages;
+		compactPipelineCreateInfo.pVertexInputState = &compactVertexInputCreateInfo;
+
+		result = vkCreateGraphicsPipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &compactPipelineCreateInfo, nullptr, &compactPipeline);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create a Graphics Pipeline!");
+		}
+
+		vkDestroyShaderModule(mainDevice.logicalDevice, compactVertexShaderModule, nullptr);
+	}
+
+	// CREATE INSTANCED PIPELINES
+	// Model matrix is read per instance from the transform buffer (binding 1, firstInstance picks the mesh's slot),
+	// so recorded draws stay valid while models move
+	VkVertexInputBindingDescription transformBindingDescription = {};
+	transformBindingDescription.binding = 1;
+	transformBindingDescription.stride = sizeof(glm::mat4);
+	transformBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	// A mat4 attribute takes one location per column
+	std::array<VkVertexInputAttributeDescription, 4> transformAttributeDescriptions;
+	for (uint32_t i = 0; i < 4; i++) {
+		transformAttributeDescriptions[i].binding = 1;
+		transformAttributeDescriptions[i].location = 3 + i;
+		transformAttributeDescriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		transformAttributeDescriptions[i].offset = sizeof(glm::vec4) * i;
+	}
+
+	std::ifstream instancedShaderFile("Shaders/instanced_vert.spv");
+	if (instancedShaderFile.is_open()) {
+		instancedShaderFile.close();
+		auto instancedVertexShaderCode = readFile("Shaders/instanced_vert.spv");
+		VkShaderModule instancedVertexShaderModule = createShaderModule(instancedVertexShaderCode);
+
+		VkPipelineShaderStageCreateInfo instancedShaderStages [] = {vertexShaderCreateInfo, fragmentShaderCreateInfo};
+		instancedShaderStages[0].module = instancedVertexShaderModule;
+
+		std::array<VkVertexInputBindingDescription, 2> instancedBindingDescriptions = {bindingDescription, transformBindingDescription};
+		std::vector<VkVertexInputAttributeDescription> instancedAttributeDescriptions(attributeDescriptions.begin(), attributeDescriptions.end());
+		instancedAttributeDescriptions.insert(instancedAttributeDescriptions.end(), transformAttributeDescriptions.begin(), transformAttributeDescriptions.end());
+
+		VkPipelineVertexInputStateCreateInfo instancedVertexInputCreateInfo = vertexInputCreateInfo;
+		instancedVertexInputCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(instancedBindingDescriptions.size());
+		instancedVertexInputCreateInfo.pVertexBindingDescriptions = instancedBindingDescriptions.data();
+		instancedVertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(instancedAttributeDescriptions.size());
+		instancedVertexInputCreateInfo.pVertexAttributeDescriptions = instancedAttributeDescriptions.data();
+
+		VkGraphicsPipelineCreateInfo instancedPipelineCreateInfo = pipelineCreateInfo;
+		instancedPipelineCreateInfo.pStages = instancedShaderStages;
+		instancedPipelineCreateInfo.pVertexInputState = &instancedVertexInputCreateInfo;
+
+		result = vkCreateGraphicsPipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &instancedPipelineCreateInfo, nullptr, &instancedPipeline);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create a Graphics Pipeline!");
+		}
+
+		vkDestroyShaderModule(mainDevice.logicalDevice, instancedVertexShaderModule, nullptr);
+	}
+	else if (reuseCommandBuffers || indirectDraws) {
+		// Only pushed transforms work without it, which is not what was asked for
+		throw std::runtime_error("Failed to create the instanced pipeline, Shaders/instanced_vert.spv not found (run compile_shaders.bat)!");
+	}
+
+	// Compact one only pushes the mesh's dequantize matrix, which never changes
+	std::ifstream compactInstancedShaderFile("Shaders/compact_instanced_vert.spv");
+	if (instancedPipeline != VK_NULL_HANDLE && compactInstancedShaderFile.is_open()) {
+		compactInstancedShaderFile.close();
+		auto compactInstancedVertexShaderCode = readFile("Shaders/compact_instanced_vert.spv");
+		VkShaderModule compactInstancedVertexShaderModule = createShaderModule(compactInstancedVertexShaderCode);
+
+		VkPipelineShaderStageCreateInfo compactInstancedShaderStages [] = {vertexShaderCreateInfo, fragmentShaderCreateInfo};
+		compactInstancedShaderStages[0].module = compactInstancedVertexShaderModule;
+
+		VkVertexInputBindingDescription compactBindingDescription = bindingDescription;
+		compactBindingDescription.stride = sizeof(CompactVertex);
+		std::array<VkVertexInputBindingDescription, 2> compactInstancedBindingDescriptions = {compactBindingDescription, transformBindingDescription};
+
+		// Position (0..1 inside the mesh bounds) and texture attributes, as in the compact pipeline
+		std::vector<VkVertexInputAttributeDescription> compactInstancedAttributeDescriptions(2);
+		compactInstancedAttributeDescriptions[0].binding = 0;
+		compactInstancedAttributeDescriptions[0].location = 0;
+		compactInstancedAttributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+		compactInstancedAttributeDescriptions[0].offset = offsetof(CompactVertex, pos);
+		compactInstancedAttributeDescriptions[1].binding = 0;
+		compactInstancedAttributeDescriptions[1].location = 2;
+		compactInstancedAttributeDescriptions[1].format = VK_FORMAT_R16G16_SFLOAT;
+		compactInstancedAttributeDescriptions[1].offset = offsetof(CompactVertex, tex);
+		compactInstancedAttributeDescriptions.insert(compactInstancedAttributeDescriptions.end(), transformAttributeDescriptions.begin(), transformAttributeDescriptions.end());
+
+		VkPipelineVertexInputStateCreateInfo compactInstancedVertexInputCreateInfo = vertexInputCreateInfo;
+		compactInstancedVertexInputCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(compactInstancedBindingDescriptions.size());
+		compactInstancedVertexInputCreateInfo.pVertexBindingDescriptions = compactInstancedBindingDescriptions.data();
+		compactInstancedVertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(compactInstancedAttributeDescriptions.size());
+		compactInstancedVertexInputCreateInfo.pVertexAttributeDescriptions = compactInstancedAttributeDescriptions.data();
+
+		VkGraphicsPipelineCreateInfo compactInstancedPipelineCreateInfo = pipelineCreateInfo;
+		compactInstancedPipelineCreateInfo.pStages = compactInstancedShaderStages;
+		compactInstancedPipelineCreateInfo.pVertexInputState = &compactInstancedVertexInputCreateInfo;
+
+		result = vkCreateGraphicsPipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &compactInstancedPipelineCreateInfo, nullptr, &compactInstancedPipeline);
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create a Graphics Pipeline!");
+		}
+
+		vkDestroyShaderModule(mainDevice.logicalDevice, compactInstancedVertexShaderModule, nullptr);
+	}
+
+	// Pushed transforms are part of the recording, so only the instanced pipelines allow keeping it
+	reuseCommandBuffers = reuseCommandBuffers && instancedPipeline != VK_NULL_HANDLE;
+
+	// Same for indirect draws, which also start their instances at the mesh's transform slot
+	if (indirectDraws && (instancedPipeline == VK_NULL_HANDLE || !drawIndirectFirstInstanceSupported)) {
+		std::cout << "Indirect draws need instanced transforms and drawIndirectFirstInstance, meshes are drawn directly" << std::endl;
+		indirectDraws = false;
+	}
+
 	// Destroy Shader Modules, no longer needed after Pipeline created
 	vkDestroyShaderModule(mainDevice.logicalDevice, fragmentShaderModule, nullptr);
 	vkDestroyShaderModule(mainDevice.logicalDevice, vertexShaderModule, nullptr);
@@ -1158,6 +1579,260 @@ void Render::createGraphicsPipeline() {
 
 }
 
+void Render::createCullPipeline() {
+	// CULL DESCRIPTOR SET LAYOUT
+	// Camera data, meshlets, draws written, draw counts written and mesh transforms
+	std::array<VkDescriptorSetLayoutBinding, 5> cullBindings = {};
+	for (size_t i = 0; i < cullBindings.size(); i++) {
+		cullBindings[i].binding = static_cast<uint32_t>(i);
+		cullBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cullBindings[i].descriptorCount = 1;
+		cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		cullBindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo cullLayoutCreateInfo = {};
+	cullLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	cullLayoutCreateInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+	cullLayoutCreateInfo.pBindings = cullBindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &cullLayoutCreateInfo, nullptr, &cullSetLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Descriptor Set Layout!");
+	}
+
+	// CULL PIPELINE LAYOUT
+	VkPushConstantRange cullPushConstantRange = {};
+	cullPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullPushConstantRange.offset = 0;
+	cullPushConstantRange.size = sizeof(CullPush);
+
+	VkPipelineLayoutCreateInfo cullPipelineLayoutCreateInfo = {};
+	cullPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	cullPipelineLayoutCreateInfo.setLayoutCount = 1;
+	cullPipelineLayoutCreateInfo.pSetLayouts = &cullSetLayout;
+	cullPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	cullPipelineLayoutCreateInfo.pPushConstantRanges = &cullPushConstantRange;
+
+	result = vkCreatePipelineLayout(mainDevice.logicalDevice, &cullPipelineLayoutCreateInfo, nullptr, &cullPipelineLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Pipeline Layout!");
+	}
+
+	// CULL PIPELINE
+	// Visible meshlet count is only known on the GPU, so without draw count buffers meshlets are not used at all.
+	// Meshlet draws also start at the mesh's transform slot
+	if (!drawIndirectCountSupported || !drawIndirectFirstInstanceSupported) {
+		std::cout << "Draw count buffers or indirect first instance not supported, models asking for meshlets are drawn whole" << std::endl;
+		return;
+	}
+
+	// Missing shader only fails the models that ask for meshlets (see loadModel)
+	std::ifstream cullShaderFile("Shaders/cull_comp.spv");
+	if (!cullShaderFile.is_open()) {
+		return;
+	}
+	cullShaderFile.close();
+
+	auto cullShaderCode = readFile("Shaders/cull_comp.spv");
+	VkShaderModule cullShaderModule = createShaderModule(cullShaderCode);
+
+	VkPipelineShaderStageCreateInfo cullShaderCreateInfo = {};
+	cullShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	cullShaderCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullShaderCreateInfo.module = cullShaderModule;
+	cullShaderCreateInfo.pName = "main";
+
+	VkComputePipelineCreateInfo cullPipelineCreateInfo = {};
+	cullPipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	cullPipelineCreateInfo.stage = cullShaderCreateInfo;
+	cullPipelineCreateInfo.layout = cullPipelineLayout;
+	cullPipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	cullPipelineCreateInfo.basePipelineIndex = -1;
+
+	result = vkCreateComputePipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &cullPipelineCreateInfo, nullptr, &cullPipeline);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Compute Pipeline!");
+	}
+
+	vkDestroyShaderModule(mainDevice.logicalDevice, cullShaderModule, nullptr);
+}
+
+void Render::createDrawCullPipeline() {
+	// DRAW CULL DESCRIPTOR SET LAYOUT
+	// Camera data, source draws, draw infos, mesh transforms, draws written, run counts written, stats,
+	// depth pyramid and draws held back by the early phase
+	std::array<VkDescriptorSetLayoutBinding, 9> drawCullBindings = {};
+	for (size_t i = 0; i < drawCullBindings.size(); i++) {
+		drawCullBindings[i].binding = static_cast<uint32_t>(i);
+		drawCullBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+			: i == 7 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		drawCullBindings[i].descriptorCount = 1;
+		drawCullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		drawCullBindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo drawCullLayoutCreateInfo = {};
+	drawCullLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	drawCullLayoutCreateInfo.bindingCount = static_cast<uint32_t>(drawCullBindings.size());
+	drawCullLayoutCreateInfo.pBindings = drawCullBindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &drawCullLayoutCreateInfo, nullptr, &drawCullSetLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Descriptor Set Layout!");
+	}
+
+	// DRAW CULL PIPELINE LAYOUT
+	VkPushConstantRange drawCullPushConstantRange = {};
+	drawCullPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	drawCullPushConstantRange.offset = 0;
+	drawCullPushConstantRange.size = sizeof(DrawCullPush);
+
+	VkPipelineLayoutCreateInfo drawCullPipelineLayoutCreateInfo = {};
+	drawCullPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	drawCullPipelineLayoutCreateInfo.setLayoutCount = 1;
+	drawCullPipelineLayoutCreateInfo.pSetLayouts = &drawCullSetLayout;
+	drawCullPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	drawCullPipelineLayoutCreateInfo.pPushConstantRanges = &drawCullPushConstantRange;
+
+	result = vkCreatePipelineLayout(mainDevice.logicalDevice, &drawCullPipelineLayoutCreateInfo, nullptr, &drawCullPipelineLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Pipeline Layout!");
+	}
+
+	// DRAW CULL PIPELINE
+	// Culls the indirect draws only, and each run's surviving draw count is only known on the GPU.
+	// CPU culling leaves nothing for it to drop
+	if (!gpuFrustumCulling || !indirectDraws || cpuFrustumCulling) {
+		gpuFrustumCulling = false;
+		return;
+	}
+	if (!drawIndirectCountSupported) {
+		std::cout << "Draw count buffers not supported, meshes are not frustum culled" << std::endl;
+		gpuFrustumCulling = false;
+		return;
+	}
+
+	std::ifstream drawCullShaderFile("Shaders/draw_cull_comp.spv");
+	if (!drawCullShaderFile.is_open()) {
+		throw std::runtime_error("Failed to create the draw cull pipeline, Shaders/draw_cull_comp.spv not found (run compile_shaders.bat)!");
+	}
+	drawCullShaderFile.close();
+
+	auto drawCullShaderCode = readFile("Shaders/draw_cull_comp.spv");
+	VkShaderModule drawCullShaderModule = createShaderModule(drawCullShaderCode);
+
+	VkPipelineShaderStageCreateInfo drawCullShaderCreateInfo = {};
+	drawCullShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	drawCullShaderCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	drawCullShaderCreateInfo.module = drawCullShaderModule;
+	drawCullShaderCreateInfo.pName = "main";
+
+	VkComputePipelineCreateInfo drawCullPipelineCreateInfo = {};
+	drawCullPipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	drawCullPipelineCreateInfo.stage = drawCullShaderCreateInfo;
+	drawCullPipelineCreateInfo.layout = drawCullPipelineLayout;
+	drawCullPipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	drawCullPipelineCreateInfo.basePipelineIndex = -1;
+
+	result = vkCreateComputePipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &drawCullPipelineCreateInfo, nullptr, &drawCullPipeline);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Compute Pipeline!");
+	}
+
+	vkDestroyShaderModule(mainDevice.logicalDevice, drawCullShaderModule, nullptr);
+}
+
+void Render::createDepthPyramidPipeline() {
+	// DEPTH PYRAMID DESCRIPTOR SET LAYOUT
+	// Level read (depth buffer or the level above), level written
+	std::array<VkDescriptorSetLayoutBinding, 2> pyramidBindings = {};
+	for (size_t i = 0; i < pyramidBindings.size(); i++) {
+		pyramidBindings[i].binding = static_cast<uint32_t>(i);
+		pyramidBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		pyramidBindings[i].descriptorCount = 1;
+		pyramidBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pyramidBindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo pyramidLayoutCreateInfo = {};
+	pyramidLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	pyramidLayoutCreateInfo.bindingCount = static_cast<uint32_t>(pyramidBindings.size());
+	pyramidLayoutCreateInfo.pBindings = pyramidBindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &pyramidLayoutCreateInfo, nullptr, &depthPyramidSetLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Descriptor Set Layout!");
+	}
+
+	// DEPTH PYRAMID PIPELINE LAYOUT
+	VkPushConstantRange pyramidPushConstantRange = {};
+	pyramidPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pyramidPushConstantRange.offset = 0;
+	pyramidPushConstantRange.size = sizeof(DepthPyramidPush);
+
+	VkPipelineLayoutCreateInfo pyramidPipelineLayoutCreateInfo = {};
+	pyramidPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pyramidPipelineLayoutCreateInfo.setLayoutCount = 1;
+	pyramidPipelineLayoutCreateInfo.pSetLayouts = &depthPyramidSetLayout;
+	pyramidPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pyramidPipelineLayoutCreateInfo.pPushConstantRanges = &pyramidPushConstantRange;
+
+	result = vkCreatePipelineLayout(mainDevice.logicalDevice, &pyramidPipelineLayoutCreateInfo, nullptr, &depthPyramidPipelineLayout);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Pipeline Layout!");
+	}
+
+	// DEPTH PYRAMID PIPELINE
+	// Only draws that go through the draw cull shader can be held back
+	if (!occlusionCulling || drawCullPipeline == VK_NULL_HANDLE) {
+		occlusionCulling = false;
+		return;
+	}
+
+	// Depth is read straight from the attachment, in the format createDepthBufferImage picks
+	VkFormat depthFormat = chooseSupportedFormat(
+		{VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT},
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	VkFormatProperties depthProperties;
+	vkGetPhysicalDeviceFormatProperties(mainDevice.physicalDevice, depthFormat, &depthProperties);
+	if ((depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) == 0) {
+		std::cout << "Depth buffer format can't be sampled, meshes are not occlusion culled" << std::endl;
+		occlusionCulling = false;
+		return;
+	}
+
+	std::ifstream pyramidShaderFile("Shaders/depth_pyramid_comp.spv");
+	if (!pyramidShaderFile.is_open()) {
+		throw std::runtime_error("Failed to create the depth pyramid pipeline, Shaders/depth_pyramid_comp.spv not found (run compile_shaders.bat)!");
+	}
+	pyramidShaderFile.close();
+
+	auto pyramidShaderCode = readFile("Shaders/depth_pyramid_comp.spv");
+	VkShaderModule pyramidShaderModule = createShaderModule(pyramidShaderCode);
+
+	VkPipelineShaderStageCreateInfo pyramidShaderCreateInfo = {};
+	pyramidShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pyramidShaderCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pyramidShaderCreateInfo.module = pyramidShaderModule;
+	pyramidShaderCreateInfo.pName = "main";
+
+	VkComputePipelineCreateInfo pyramidPipelineCreateInfo = {};
+	pyramidPipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pyramidPipelineCreateInfo.stage = pyramidShaderCreateInfo;
+	pyramidPipelineCreateInfo.layout = depthPyramidPipelineLayout;
+	pyramidPipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pyramidPipelineCreateInfo.basePipelineIndex = -1;
+
+	result = vkCreateComputePipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &pyramidPipelineCreateInfo, nullptr, &depthPyramidPipeline);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Compute Pipeline!");
+	}
+
+	vkDestroyShaderModule(mainDevice.logicalDevice, pyramidShaderModule, nullptr);
+}
+
 VkShaderModule Render::createShaderModule(const std::vector<char>& code) {
 	// Shader Module creation information
 	VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
@@ -1179,24 +1854,49 @@ void Render::draw() {
 	// -- GET NEXT IMAGE --
 	// Wait for given fence to signal (open) from last draw before continuing
 	vkWaitForFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-	// Manually reset (close) fences
-	vkResetFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame]);
 
 	// Get index of next image to be drawn to, and signal semaphore when ready to be drawn to
 	uint32_t imageIndex;
 	vkAcquireNextImageKHR(mainDevice.logicalDevice, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
-	recordCommands(imageIndex);
+	// More frames than images can be in flight, so the image may still be drawn by a submit from another frame.
+	// Its per image buffers (transforms, indirect commands, cull data and stats) are only written once that one finished
+	if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+		vkWaitForFences(mainDevice.logicalDevice, 1, &imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	imagesInFlight[imageIndex] = drawFences[currentFrame];
+	// Manually reset (close) fences, only after the image wait as it can be the same fence
+	vkResetFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame]);
+
+	// Submit uploads of models staged by loader threads, and add finished ones to the scene
+	updateModelLoads();
+
+	// Draws are only recorded again when the scene changed since this image's buffer was recorded
+	selectMeshLods();
+	if (!commandBufferRecorded[imageIndex]) {
+		recordCommands(imageIndex);
+	}
 	updateUniformBuffers(imageIndex);
 	
 	// -- SUBMIT COMMAND BUFFER TO RENDER --
 	// Queue submission information
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;										// Number of semaphores to wait on
-	submitInfo.pWaitSemaphores = &imageAvailable[currentFrame];				// List of semaphores to wait on
+	// Also wait for uploads to reach the graphics queue before vertex input/texture/meshlet reads use them
+	VkSemaphore waitSemaphores [] = {imageAvailable[currentFrame], uploadContext.timeline};
+	uint64_t waitValues [] = {0, uploadWaitValue};							// Binary semaphore value is ignored
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = 2;
+	timelineInfo.pWaitSemaphoreValues = waitValues;
+
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = 2;										// Number of semaphores to wait on
+	submitInfo.pWaitSemaphores = waitSemaphores;							// List of semaphores to wait on
 	VkPipelineStageFlags waitStages [] = {
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
 	};
 	submitInfo.pWaitDstStageMask = waitStages;						// Stages to check semaphores at
 	submitInfo.commandBufferCount = 1;								// Number of command buffers to submit
@@ -1273,6 +1973,15 @@ void Render::createCommandPool() {
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create a Command Pool!");
 	}
+
+	// Create a Transfer Queue Family Command Pool (upload command buffers are short lived)
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+
+	result = vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, nullptr, &transferCommandPool);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Transfer Command Pool!");
+	}
 }
 
 void Render::createCommandBuffers() {
@@ -1291,12 +2000,40 @@ void Render::createCommandBuffers() {
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("Failed to allocate Command Buffers!");
 	}
+
+	// Nothing recorded yet
+	commandBufferRecorded.assign(commandBuffers.size(), false);
+	drawKeys.resize(commandBuffers.size());
+}
+
+void Render::createRecordContexts() {
+	recordPool = std::make_unique<ThreadPool>(recordThreads);
+
+	// Command pools need external synchronisation, so every recording thread (workers + main) gets one per image
+	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(mainDevice.physicalDevice);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;				// Whole pool is reset on every recording of its image
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+
+	recordContexts.resize(commandBuffers.size());
+	for (auto& imageContexts : recordContexts) {
+		imageContexts.resize(recordPool->getThreadCount() + 1);
+		for (auto& context : imageContexts) {
+			VkResult result = vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, nullptr, &context.commandPool);
+			if (result != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create a Command Pool!");
+			}
+		}
+	}
 }
 
 void Render::createSynchronisation() {
 	imageAvailable.resize(MAX_FRAME_DRAWS);
 	renderFinished.resize(MAX_FRAME_DRAWS);
 	drawFences.resize(MAX_FRAME_DRAWS);
+	imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
 
 	// Semaphore creation information
 	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
@@ -1317,94 +2054,741 @@ void Render::createSynchronisation() {
 }
 
 
-void Render::recordCommands(uint32_t currentImage) {
-	// Information about how to begin each command buffer
-	VkCommandBufferBeginInfo bufferBeginInfo = {};
-	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-	// Information about how to begin a render pass (only needed for graphical applications)
-	VkRenderPassBeginInfo renderPassBeginInfo = {};
-	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBeginInfo.renderPass = renderPass;							// Render Pass to begin
-	renderPassBeginInfo.renderArea.offset = {0, 0};						// Start point of render pass in pixels
-	renderPassBeginInfo.renderArea.extent = swapChainExtent;				// Size of region to run render pass on (starting at offset)
-
-	std::array<VkClearValue, 3> clearValues = {};
-	clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-	clearValues[1].color = {50.0f / 255.0f, 145.0f / 255.0f, 168.0f / 255.0f, 1.0f};
-	clearValues[2].depthStencil.depth = 1.0f;
+void Render::createUploadContext() {
+	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(mainDevice.physicalDevice);
 
-	renderPassBeginInfo.pClearValues = clearValues.data();					// List of clear values
-	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	// Timeline semaphore counts up once per upload submit, so any number of uploads can be waited on with one semaphore
+	VkSemaphoreTypeCreateInfo timelineCreateInfo = {};
+	timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineCreateInfo.initialValue = 0;
 
-	renderPassBeginInfo.framebuffer = swapChainFramebuffers[currentImage];
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreCreateInfo.pNext = &timelineCreateInfo;
 
-	// Start recording commands to command buffer!
-	VkResult result = vkBeginCommandBuffer(commandBuffers[currentImage], &bufferBeginInfo);
+	VkResult result = vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &uploadContext.timeline);
 	if (result != VK_SUCCESS) {
-		throw std::runtime_error("Failed to start recording a Command Buffer!");
+		throw std::runtime_error("Failed to create the Upload Timeline Semaphore!");
 	}
 
-	// Begin Render Pass
-	vkCmdBeginRenderPass(commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	uploadContext.device = mainDevice.logicalDevice;
+	uploadContext.allocator = memoryAllocator.get();
+	uploadContext.transferQueue = transferQueue;
+	uploadContext.transferCommandPool = transferCommandPool;
+	uploadContext.transferFamily = static_cast<uint32_t>(queueFamilyIndices.transferFamily);
+	uploadContext.graphicsQueue = graphicsQueue;
+	uploadContext.graphicsCommandPool = graphicsCommandPool;
+	uploadContext.graphicsFamily = static_cast<uint32_t>(queueFamilyIndices.graphicsFamily);
+}
 
-	// Bind Pipeline to be used in render pass
-	vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+void Render::selectMeshLods() {
+	// LOD SELECTION
+	// Size on screen (in pixels) of one world space unit at distance 1, from the vertical field of view
+	glm::vec3 cameraPosition = glm::vec3(glm::inverse(uboViewProjection.view)[3]);
+	float pixelsPerUnit = fabs(uboViewProjection.projection[1][1]) * swapChainExtent.height * 0.5f;
 
+	std::vector<float> modelLodErrors(meshList.size(), 0.0f);		// World space
 	for (size_t j = 0; j < meshList.size(); j++) {
-		MeshModel thisModel = meshList[j];
+		if (modelStatus[j] != ModelStatus::Ready) {
+			continue;
+		}
 
-		vkCmdPushConstants(
-			commandBuffers[currentImage],
-			pipelineLayout,
-			VK_SHADER_STAGE_VERTEX_BIT,		// Stage to push constants to
-			0,								// Offset of push constants to update
-			sizeof(glm::mat4),					// Size of data being pushed
-			&thisModel.getModel());			// Actual data being pushed (can be array)
+		// Only nodes moved since last frame (or everything below a moved model) are recomputed
+		meshList[j].updateTransforms();
 
-		for (size_t k = 0; k < thisModel.getMeshCount(); k++) {
+		// Largest world space error that stays under LOD_PIXEL_ERROR pixels, from the model's projected bounding sphere.
+		// All copies share one draw, so the closest copy picks the LOD
+		auto getLodError = [&](const glm::mat4& model) {
+			glm::vec3 modelCenter = glm::vec3(model * glm::vec4(meshList[j].getBoundsCenter(), 1.0f));
+			float distance = glm::length(modelCenter - cameraPosition) - meshList[j].getBoundsRadius() * getMaxScale(model);
+			return distance > 0.0f ? LOD_PIXEL_ERROR * distance / pixelsPerUnit : 0.0f;		// Camera inside the sphere: full detail
+		};
 
-			VkBuffer vertexBuffers [] = {thisModel.getMesh(k)->getVertexBuffer()};					// Buffers to bind
-			VkDeviceSize offsets [] = {0};												// Offsets into buffers being bound
-			vkCmdBindVertexBuffers(commandBuffers[currentImage], 0, 1, vertexBuffers, offsets);	// Command to bind vertex buffer before drawing with them
+		modelLodErrors[j] = getLodError(meshList[j].getModel());
+		for (int instanceId : modelInstances[j]) {
+			modelLodErrors[j] = std::min(modelLodErrors[j], getLodError(instances[instanceId].transform));
+		}
+	}
 
-			// Bind mesh index buffer, with 0 offset and using the uint32 type
-			vkCmdBindIndexBuffer(commandBuffers[currentImage], thisModel.getMesh(k)->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	// Every mesh of a ready model gets one draw and a range of transform slots (model's copy, then its instances).
+	// Mesh errors are in mesh space, so the world error shrinks with the mesh's scale
+	modelFirstDraw.assign(meshList.size(), 0);
+	meshDraws.clear();
+	meshLods.clear();
+	uint32_t transformCount = 0;
+	for (size_t j = 0; j < meshList.size(); j++) {
+		modelFirstDraw[j] = static_cast<uint32_t>(meshDraws.size());
+		if (modelStatus[j] != ModelStatus::Ready) {
+			continue;
+		}
 
-			// Dynamic Offset Amount
-			// uint32_t dynamicOffset = static_cast<uint32_t>(modelUniformAlignment) * j;
+		uint32_t instanceCount = 1 + static_cast<uint32_t>(modelInstances[j].size());
+		for (size_t k = 0; k < meshList[j].getMeshCount(); k++) {
+			float meshScale = getMaxScale(meshList[j].getMeshTransform(k));
+			float maxError = meshScale > 0.0f ? modelLodErrors[j] / meshScale : 0.0f;
+			meshDraws.push_back({static_cast<uint32_t>(j), static_cast<uint32_t>(k), transformCount, instanceCount});
+			meshLods.push_back(meshList[j].getMesh(k)->getLodForError(maxError));
+			transformCount += instanceCount;
+		}
+	}
 
-			// "Push" constants to given shader stage directly (no buffer)
+	// FRUSTUM CULLING
+	if (cpuFrustumCulling) {
+		cullMeshDraws();
+	}
+	else {
+		drawVisible.assign(meshDraws.size(), 1);
+	}
 
+	// Direct draws have their LOD ranges baked in. Indirect ones read them every frame,
+	// so their recording only changes when a mesh goes in or out of meshlet culling (full detail).
+	// Draws culled on the CPU are left out of the recording
+	std::vector<uint32_t> recordedLods = meshLods;
+	if (indirectDraws) {
+		for (size_t drawIndex = 0; drawIndex < recordedLods.size(); drawIndex++) {
+			Mesh* mesh = meshList[meshDraws[drawIndex].model].getMesh(meshDraws[drawIndex].mesh);
+			recordedLods[drawIndex] = mesh->getMeshletCount() > 0 && meshLods[drawIndex] == 0 ? 1 : 0;
+		}
+	}
+	for (size_t drawIndex = 0; drawIndex < recordedLods.size(); drawIndex++) {
+		if (!drawVisible[drawIndex]) {
+			recordedLods[drawIndex] = ~0u;
+		}
+	}
+	if (recordedLods != recordedMeshLods) {
+		recordedMeshLods.swap(recordedLods);
+		invalidateCommandBuffers();
+	}
+}
 
-			std::array<VkDescriptorSet, 2> descriptorSetGroup = {descriptorSets[currentImage],
-				samplerDescriptorSets[thisModel.getMesh(k)->getTexId()]};
+void Render::cullMeshDraws() {
+	// World box of every copy of every mesh draw, in transform slot order (same transforms as updateUniformBuffers writes)
+	cullBoxes.clear();
+	for (size_t j = 0; j < meshList.size(); j++) {
+		if (modelStatus[j] != ModelStatus::Ready) {
+			continue;
+		}
 
-			// Bind Descriptor Sets
-			vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-				0, static_cast<uint32_t>(descriptorSetGroup.size()), descriptorSetGroup.data(), 0, nullptr);
+		for (uint32_t drawIndex = modelFirstDraw[j]; drawIndex < modelFirstDraw[j] + meshList[j].getMeshCount(); drawIndex++) {
+			const MeshDraw& meshDraw = meshDraws[drawIndex];
+			Mesh* mesh = meshList[j].getMesh(meshDraw.mesh);
+			glm::vec3 center = (mesh->getBoundsMin() + mesh->getBoundsMax()) * 0.5f;
+			glm::vec3 extent = (mesh->getBoundsMax() - mesh->getBoundsMin()) * 0.5f;
 
-			// Execute pipeline
-			vkCmdDrawIndexed(commandBuffers[currentImage], thisModel.getMesh(k)->getIndexCount(), 1, 0, 0, 0);
+			for (uint32_t instance = 0; instance < meshDraw.instanceCount; instance++) {
+				glm::vec3 worldCenter, worldExtent;
+				FRUSTUM_CULL::transformBox(getInstanceTransform(meshDraw, instance), center, extent, worldCenter, worldExtent);
+				cullBoxes.push(worldCenter, worldExtent);
+			}
 		}
 	}
 
-	// Start second subpass
-	vkCmdNextSubpass(commandBuffers[currentImage], VK_SUBPASS_CONTENTS_INLINE);
-
-	vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, secondPipeline);
-	vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, secondPipelineLayout,
+	// Batch plane test over every box (4 or 8 per step), only the test itself is timed
+	glm::vec4 planes[6];
+	FRUSTUM_CULL::getFrustumPlanes(uboViewProjection.projection * uboViewProjection.view, planes);
+
+	auto cullStart = std::chrono::steady_clock::now();
+	FRUSTUM_CULL::cullBoxes(cullBoxes, planes, cullBoxVisible);
+	double cullNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - cullStart).count();
+
+	// A draw stays while any of its copies is visible, they are one instanced draw
+	drawVisible.assign(meshDraws.size(), 0);
+	cullStats = CullStats();
+	for (size_t drawIndex = 0; drawIndex < meshDraws.size(); drawIndex++) {
+		const MeshDraw& meshDraw = meshDraws[drawIndex];
+		for (uint32_t i = 0; i < meshDraw.instanceCount && !drawVisible[drawIndex]; i++) {
+			drawVisible[drawIndex] = cullBoxVisible[meshDraw.firstTransform + i];
+		}
+		if (drawVisible[drawIndex]) {
+			cullStats.visibleCount++;
+		}
+		else {
+			cullStats.culledCount++;
+		}
+	}
+	cullStats.nanosecondsPerObject = cullBoxes.size() > 0 ? cullNs / cullBoxes.size() : 0.0;
+}
+
+void Render::invalidateCommandBuffers() {
+	std::fill(commandBufferRecorded.begin(), commandBufferRecorded.end(), false);
+}
+
+size_t Render::getTransformCount() {
+	// Same slots selectMeshLods hands out: every mesh of a ready model, once for the model and once per instance
+	size_t transformCount = 0;
+	for (size_t j = 0; j < meshList.size(); j++) {
+		if (modelStatus[j] == ModelStatus::Ready) {
+			transformCount += meshList[j].getMeshCount() * (1 + modelInstances[j].size());
+		}
+	}
+	return transformCount;
+}
+
+uint32_t Render::getDrawLimit() {
+	// Draws are in slot order, so the ones whose copies all fit in the transform buffer come first
+	uint32_t drawLimit = 0;
+	while (drawLimit < meshDraws.size() && meshDraws[drawLimit].firstTransform + meshDraws[drawLimit].instanceCount <= MAX_DRAW_TRANSFORMS) {
+		drawLimit++;
+	}
+	return drawLimit;
+}
+
+glm::mat4 Render::getInstanceTransform(const MeshDraw& meshDraw, uint32_t instance) {
+	if (instance == 0) {
+		return meshList[meshDraw.model].getMeshTransform(meshDraw.mesh);
+	}
+
+	// Instance transform takes the model matrix's place above the node transforms
+	const ModelInstance& modelInstance = instances[modelInstances[meshDraw.model][instance - 1]];
+	return modelInstance.transform * meshList[meshDraw.model].getMeshModelTransform(meshDraw.mesh);
+}
+
+VkPipeline Render::getMeshPipeline(VertexFormat vertexFormat) {
+	// Instanced pipelines are used for everything once the full one exists, both share pipelineLayout with the pushed ones
+	if (instancedPipeline != VK_NULL_HANDLE) {
+		return vertexFormat == VertexFormat::Compact ? compactInstancedPipeline : instancedPipeline;
+	}
+	return vertexFormat == VertexFormat::Compact ? compactPipeline : graphicsPipeline;
+}
+
+void Render::recordCommands(uint32_t currentImage) {
+	// Information about how to begin each command buffer
+	VkCommandBufferBeginInfo bufferBeginInfo = {};
+	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	// Information about how to begin a render pass (only needed for graphical applications)
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = renderPass;							// Render Pass to begin
+	renderPassBeginInfo.renderArea.offset = {0, 0};						// Start point of render pass in pixels
+	renderPassBeginInfo.renderArea.extent = swapChainExtent;				// Size of region to run render pass on (starting at offset)
+
+	std::array<VkClearValue, 3> clearValues = {};
+	clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+	clearValues[1].color = {50.0f / 255.0f, 145.0f / 255.0f, 168.0f / 255.0f, 1.0f};
+	clearValues[2].depthStencil.depth = 1.0f;
+
+	renderPassBeginInfo.pClearValues = clearValues.data();					// List of clear values
+	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+
+	renderPassBeginInfo.framebuffer = swapChainFramebuffers[currentImage];
+
+	// Buffers handed out for this image last time it was recorded go back to their pools.
+	// Only safe because draw() waited on imagesInFlight, the image's previous submit may still be running otherwise
+	for (auto& context : recordContexts[currentImage]) {
+		vkResetCommandPool(mainDevice.logicalDevice, context.commandPool, 0);
+		context.usedCount = 0;
+	}
+
+	// Start recording commands to command buffer!
+	VkResult result = vkBeginCommandBuffer(commandBuffers[currentImage], &bufferBeginInfo);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to start recording a Command Buffer!");
+	}
+
+	// MESHLET CULLING
+	// Meshes drawn at full detail that have meshlets get their visible meshlets written as indirect draws.
+	// Compute can't run inside a render pass, so every cull is recorded up front
+	// Draws past the transform buffer are not drawn
+	uint32_t drawLimit = getDrawLimit();
+
+	// Instanced draws are drawn whole, the cull shader handles one transform per mesh
+	std::vector<CullPush> cullPushes;
+	std::vector<int> drawCullBatches(drawLimit, -1);		// Index into cullPushes per mesh draw (-1 = drawn whole)
+	if (cullPipeline != VK_NULL_HANDLE) {
+		uint32_t drawCount = 0;
+		for (uint32_t drawIndex = 0; drawIndex < drawLimit; drawIndex++) {
+			const MeshDraw& meshDraw = meshDraws[drawIndex];
+			Mesh* mesh = meshList[meshDraw.model].getMesh(meshDraw.mesh);
+			if (!drawVisible[drawIndex] || mesh->getMeshletCount() == 0 || meshLods[drawIndex] != 0 || meshDraw.instanceCount > 1) {
+				continue;
+			}
+			if (cullPushes.size() >= MAX_CULLED_MESHES || drawCount + mesh->getMeshletCount() > MAX_MESHLET_DRAWS) {
+				continue;
+			}
+
+			CullPush push;
+			push.firstMeshlet = mesh->getFirstMeshlet();
+			push.meshletCount = mesh->getMeshletCount();
+			push.firstDraw = drawCount;
+			push.countIndex = static_cast<uint32_t>(cullPushes.size());
+			push.transformSlot = meshDraw.firstTransform;
+
+			drawCullBatches[drawIndex] = static_cast<int>(cullPushes.size());
+			cullPushes.push_back(push);
+			drawCount += push.meshletCount;
+		}
+	}
+
+	if (!cullPushes.empty()) {
+		// Last frame's draws from this image's buffers must be done before they are overwritten
+		vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+		// Every culled mesh starts with no draws
+		vkCmdFillBuffer(commandBuffers[currentImage], meshletCountBuffer[currentImage], 0, sizeof(uint32_t) * cullPushes.size(), 0);
+
+		VkMemoryBarrier clearBarrier = {};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout,
+			0, 1, &cullDescriptorSets[currentImage], 0, nullptr);
+
+		// One invocation per meshlet (workgroups of 64)
+		for (auto& push : cullPushes) {
+			vkCmdPushConstants(commandBuffers[currentImage], cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPush), &push);
+			vkCmdDispatch(commandBuffers[currentImage], (push.meshletCount + 63) / 64, 1, 1);
+		}
+
+		// Draws and counts are read as indirect parameters in the render pass
+		VkMemoryBarrier cullBarrier = {};
+		cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+			1, &cullBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// DRAW SORTING
+	// Key per draw (pipeline, index type, texture, view depth, draw index), so draws sharing state end up next to each other.
+	// Depth is the model's copy's, instances don't move the draw. Draws culled on the CPU are left out
+	std::vector<uint64_t>& imageDrawKeys = drawKeys[currentImage];
+	imageDrawKeys.clear();
+	for (uint32_t drawIndex = 0; drawIndex < drawLimit; drawIndex++) {
+		if (!drawVisible[drawIndex]) {
+			continue;
+		}
+		MeshModel& thisModel = meshList[meshDraws[drawIndex].model];
+		Mesh* mesh = thisModel.getMesh(meshDraws[drawIndex].mesh);
+
+		glm::vec4 viewCenter = uboViewProjection.view * thisModel.getMeshTransform(meshDraws[drawIndex].mesh) * glm::vec4(mesh->getBoundsCenter(), 1.0f);
+		float sortDepth = (-viewCenter.z - CAMERA_NEAR_PLANE) / (CAMERA_FAR_PLANE - CAMERA_NEAR_PLANE);
+		imageDrawKeys.push_back(DRAW_SORT::makeKey(mesh->getVertexFormat() == VertexFormat::Compact ? 1 : 0,
+			mesh->getIndexType() == VK_INDEX_TYPE_UINT32 ? 1 : 0, static_cast<uint32_t>(mesh->getTexId()), sortDepth, drawIndex));
+	}
+	DRAW_SORT::radixSort(imageDrawKeys, drawKeyScratch);
+	uint32_t sortedDrawCount = static_cast<uint32_t>(imageDrawKeys.size());
+
+	// Chunks fill in their own draws' runs (draws that are not culled keep ~0)
+	if (drawCullPipeline != VK_NULL_HANDLE) {
+		drawRunStarts[currentImage].assign(sortedDrawCount, ~0u);
+	}
+
+	// Occlusion culling splits the draws in two render passes: the early one draws what last frame's depth pyramid shows,
+	// the pyramid is then built from its depth, and the late one draws what was held back but isn't hidden after all
+	bool splitPass = depthPyramidPipeline != VK_NULL_HANDLE && sortedDrawCount > 0;
+
+	// DRAW CULLING
+	// Every sorted indirect draw is tested against the frustum, and the survivors of each run are compacted
+	// to the front of the run's range. Which draws form a run is only known once the chunks below are recorded,
+	// the shader reads it from the draw infos written every frame
+	if (drawCullPipeline != VK_NULL_HANDLE && sortedDrawCount > 0) {
+		// Last frame's draws from this image's buffers must be done before they are overwritten
+		vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+		// Every run starts with no draws (in both phases), and nothing has been counted yet
+		vkCmdFillBuffer(commandBuffers[currentImage], culledCountBuffer[currentImage], 0, sizeof(uint32_t) * static_cast<VkDeviceSize>(sortedDrawCount), 0);
+		if (splitPass) {
+			vkCmdFillBuffer(commandBuffers[currentImage], culledCountBuffer[currentImage], sizeof(uint32_t) * static_cast<VkDeviceSize>(MAX_DRAW_TRANSFORMS),
+				sizeof(uint32_t) * static_cast<VkDeviceSize>(sortedDrawCount), 0);
+		}
+		vkCmdFillBuffer(commandBuffers[currentImage], cullStatsBuffer[currentImage], 0, CULL_STATS_SIZE, 0);
+
+		// (last frame's depth pyramid is read too)
+		VkMemoryBarrier clearBarrier = {};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+		// One invocation per sorted draw (workgroups of 64)
+		DrawCullPush drawCullPush;
+		drawCullPush.drawCount = sortedDrawCount;
+		drawCullPush.phase = 0;
+		drawCullPush.phaseOffset = MAX_DRAW_TRANSFORMS;
+		vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_COMPUTE, drawCullPipeline);
+		vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_COMPUTE, drawCullPipelineLayout,
+			0, 1, &drawCullDescriptorSets[currentImage], 0, nullptr);
+		vkCmdPushConstants(commandBuffers[currentImage], drawCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DrawCullPush), &drawCullPush);
+		vkCmdDispatch(commandBuffers[currentImage], (sortedDrawCount + 63) / 64, 1, 1);
+
+		// Draws and counts are read as indirect parameters in the render pass
+		VkMemoryBarrier cullBarrier = {};
+		cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+			1, &cullBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// Begin Render Pass, first subpass is made of secondary command buffers only
+	renderPassBeginInfo.renderPass = splitPass ? earlyRenderPass : renderPass;
+	vkCmdBeginRenderPass(commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+
+	// MESH DRAWS
+	// Chunks of sorted draws are recorded in parallel, each into a secondary buffer from its thread's own pool
+	// (once per phase with occlusion culling, the late phase only records the GPU culled runs)
+	uint32_t chunkCount = (sortedDrawCount + recordChunkMeshes - 1) / recordChunkMeshes;
+	drawStats = DrawStats();
+	auto recordChunks = [&](uint32_t phase) {
+		std::vector<VkCommandBuffer> drawCommandBuffers(chunkCount);
+		std::vector<DrawStats> chunkStats(chunkCount);
+		recordPool->parallelFor(chunkCount, [&](size_t chunk) {
+			int workerIndex = recordPool->getWorkerIndex();
+			RecordContext& context = recordContexts[currentImage][workerIndex < 0 ? recordPool->getThreadCount() : workerIndex];
+
+			if (context.usedCount == context.commandBuffers.size()) {
+				VkCommandBufferAllocateInfo cbAllocInfo = {};
+				cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+				cbAllocInfo.commandPool = context.commandPool;
+				cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+				cbAllocInfo.commandBufferCount = 1;
+
+				VkCommandBuffer commandBuffer;
+				VkResult allocResult = vkAllocateCommandBuffers(mainDevice.logicalDevice, &cbAllocInfo, &commandBuffer);
+				if (allocResult != VK_SUCCESS) {
+					throw std::runtime_error("Failed to allocate Command Buffers!");
+				}
+				context.commandBuffers.push_back(commandBuffer);
+			}
+			VkCommandBuffer commandBuffer = context.commandBuffers[context.usedCount++];
+
+			// Secondary buffer runs entirely inside the first subpass of this image's framebuffer
+			// (early and late passes are compatible with renderPass)
+			VkCommandBufferInheritanceInfo inheritanceInfo = {};
+			inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritanceInfo.renderPass = renderPass;
+			inheritanceInfo.subpass = 0;
+			inheritanceInfo.framebuffer = swapChainFramebuffers[currentImage];
+
+			VkCommandBufferBeginInfo secondaryBeginInfo = {};
+			secondaryBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+			secondaryBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+			VkResult beginResult = vkBeginCommandBuffer(commandBuffer, &secondaryBeginInfo);
+			if (beginResult != VK_SUCCESS) {
+				throw std::runtime_error("Failed to start recording a Command Buffer!");
+			}
+
+			size_t firstDraw = chunk * recordChunkMeshes;
+			chunkStats[chunk] = recordMeshDraws(commandBuffer, currentImage, firstDraw, std::min(firstDraw + recordChunkMeshes, static_cast<size_t>(sortedDrawCount)),
+				cullPushes, drawCullBatches, phase);
+
+			VkResult endResult = vkEndCommandBuffer(commandBuffer);
+			if (endResult != VK_SUCCESS) {
+				throw std::runtime_error("Failed to stop recording a Command Buffer!");
+			}
+			drawCommandBuffers[chunk] = commandBuffer;
+		});
+
+		for (auto& stats : chunkStats) {
+			drawStats.drawCount += stats.drawCount;
+			drawStats.drawCallCount += stats.drawCallCount;
+			drawStats.bindCount += stats.bindCount;
+			drawStats.bindsSaved += stats.bindsSaved;
+		}
+
+		// Chunks run in sorted order
+		if (!drawCommandBuffers.empty()) {
+			vkCmdExecuteCommands(commandBuffers[currentImage], static_cast<uint32_t>(drawCommandBuffers.size()), drawCommandBuffers.data());
+		}
+	};
+	recordChunks(0);
+
+	if (splitPass) {
+		// Nothing to composite yet, the late pass does it
+		vkCmdNextSubpass(commandBuffers[currentImage], VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdEndRenderPass(commandBuffers[currentImage]);
+
+		// DEPTH PYRAMID
+		// Level 0 takes the farthest depth of the texels it covers in the early pass's depth, every further level
+		// the farthest of the level above. Early pass's dependency makes its depth readable, but last frame's pyramid
+		// build and late cull must be done with the shared levels first
+		VkMemoryBarrier depthBarrier = {};
+		depthBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		depthBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &depthBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipeline);
+		DepthPyramidPush pyramidPush;
+		pyramidPush.sourceWidth = swapChainExtent.width;
+		pyramidPush.sourceHeight = swapChainExtent.height;
+		for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+			pyramidPush.width = std::max(depthPyramidWidth >> level, 1u);
+			pyramidPush.height = std::max(depthPyramidHeight >> level, 1u);
+
+			VkDescriptorSet levelSet = depthPyramidDescriptorSets[level == 0 ? currentImage : swapChainImages.size() + level - 1];
+			vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipelineLayout,
+				0, 1, &levelSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffers[currentImage], depthPyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthPyramidPush), &pyramidPush);
+			vkCmdDispatch(commandBuffers[currentImage], (pyramidPush.width + 7) / 8, (pyramidPush.height + 7) / 8, 1);
+
+			// Next level (or the late cull) reads this one
+			VkMemoryBarrier levelBarrier = {};
+			levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				1, &levelBarrier, 0, nullptr, 0, nullptr);
+
+			pyramidPush.sourceWidth = pyramidPush.width;
+			pyramidPush.sourceHeight = pyramidPush.height;
+		}
+
+		// LATE DRAW CULLING
+		// Draws the early phase held back are tested again against this frame's pyramid, survivors go to the second half
+		// of the draws and counts
+		DrawCullPush lateCullPush;
+		lateCullPush.drawCount = sortedDrawCount;
+		lateCullPush.phase = 1;
+		lateCullPush.phaseOffset = MAX_DRAW_TRANSFORMS;
+		vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_COMPUTE, drawCullPipeline);
+		vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_COMPUTE, drawCullPipelineLayout,
+			0, 1, &drawCullDescriptorSets[currentImage], 0, nullptr);
+		vkCmdPushConstants(commandBuffers[currentImage], drawCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DrawCullPush), &lateCullPush);
+		vkCmdDispatch(commandBuffers[currentImage], (sortedDrawCount + 63) / 64, 1, 1);
+
+		// Late draws read their parameters (late pass's dependency keeps depth writes behind the pyramid reads)
+		VkMemoryBarrier lateCullBarrier = {};
+		lateCullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		lateCullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		lateCullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &lateCullBarrier, 0, nullptr, 0, nullptr);
+
+		// Colour and depth carry on from the early pass (nothing is cleared)
+		renderPassBeginInfo.renderPass = lateRenderPass;
+		vkCmdBeginRenderPass(commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		recordChunks(1);
+	}
+
+	// Start second subpass
+	vkCmdNextSubpass(commandBuffers[currentImage], VK_SUBPASS_CONTENTS_INLINE);
+
+	vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, secondPipeline);
+	vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, secondPipelineLayout,
 		0, 1, &inputDescriptorSets[currentImage], 0, nullptr);
 	vkCmdDraw(commandBuffers[currentImage], 3, 1, 0, 0);
 
 	// End Render Pass
 	vkCmdEndRenderPass(commandBuffers[currentImage]);
 
+	// Draw cull stats are read by the host once the frame is done
+	if (drawCullPipeline != VK_NULL_HANDLE && sortedDrawCount > 0) {
+		VkMemoryBarrier statsBarrier = {};
+		statsBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		statsBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		statsBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+			1, &statsBarrier, 0, nullptr, 0, nullptr);
+	}
+
 	// Stop recording to command buffer
 	result = vkEndCommandBuffer(commandBuffers[currentImage]);
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("Failed to stop recording a Command Buffer!");
 	}
+
+	// Submitted again as is until the scene changes
+	commandBufferRecorded[currentImage] = reuseCommandBuffers;
+}
+
+DrawStats Render::recordMeshDraws(VkCommandBuffer commandBuffer, uint32_t currentImage, size_t firstDraw, size_t endDraw,
+	const std::vector<CullPush>& cullPushes, const std::vector<int>& drawCullBatches, uint32_t phase) {
+	// Runs on recording threads: only reads the scene, and nothing is inherited from the primary buffer.
+	// Draws come in sort key order, so every bind below is skipped while the previous draw left the same state bound
+	DrawStats stats;
+	VkDeviceSize offsets [] = {0};			// Offsets into buffers being bound
+
+	// Set 0 (view projection) is the same for every draw, pipelines share the layout so it stays bound across switches
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+		0, 1, &descriptorSets[currentImage], 0, nullptr);
+	stats.bindCount++;
+
+	// Instanced pipelines read mesh transforms per instance, each draw's first instance is its mesh's first slot
+	bool instancedTransforms = instancedPipeline != VK_NULL_HANDLE;
+	if (instancedTransforms) {
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &transformBuffer[currentImage], offsets);
+		stats.bindCount++;
+	}
+
+	const std::vector<uint64_t>& imageDrawKeys = drawKeys[currentImage];
+
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	int boundTexId = -1;
+	VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+
+	int64_t pushedNode = -1;			// Node whose transform is in the push constants
+	int64_t pushedModel = -1;			// Model that node belongs to
+
+	for (size_t draw = firstDraw; draw < endDraw; draw++) {
+		uint32_t drawIndex = DRAW_SORT::getDrawIndex(imageDrawKeys[draw]);
+		// Late phase only draws what the draw cull shader held back, which is never a meshlet culled mesh
+		if (phase == 1 && drawCullBatches[drawIndex] >= 0) {
+			continue;
+		}
+		const MeshDraw& meshDraw = meshDraws[drawIndex];
+		MeshModel& thisModel = meshList[meshDraw.model];
+		size_t k = meshDraw.mesh;
+		Mesh* mesh = thisModel.getMesh(k);
+
+		// Pipeline and arena vertex buffer both follow the vertex format
+		VkPipeline meshPipeline = getMeshPipeline(mesh->getVertexFormat());
+		if (meshPipeline != boundPipeline) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
+			VkBuffer vertexBuffers [] = {geometryArena->getVertexBuffer(mesh->getVertexFormat())};
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+			boundPipeline = meshPipeline;
+			stats.bindCount += 2;
+		}
+		else {
+			stats.bindsSaved += 2;
+		}
+
+		// "Push" constants to given shader stage directly (no buffer)
+		// Compact positions also need the mesh's dequantize matrix, full ones share their node's transform.
+		// With instanced transforms only the dequantize matrix is pushed (it never changes, so the recording stays valid)
+		if (mesh->getVertexFormat() == VertexFormat::Compact) {
+			glm::mat4 meshModel = instancedTransforms ? mesh->getDequantize() : thisModel.getMeshTransform(k) * mesh->getDequantize();
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT,
+				0, sizeof(glm::mat4), &meshModel);
+			pushedNode = -1;
+		}
+		else if (!instancedTransforms && (pushedModel != meshDraw.model || pushedNode != thisModel.getMeshNode(k))) {
+			glm::mat4 meshModel = thisModel.getMeshTransform(k);
+			vkCmdPushConstants(
+				commandBuffer,
+				pipelineLayout,
+				VK_SHADER_STAGE_VERTEX_BIT,		// Stage to push constants to
+				0,								// Offset of push constants to update
+				sizeof(glm::mat4),				// Size of data being pushed
+				&meshModel);					// Actual data being pushed (can be array)
+			pushedModel = meshDraw.model;
+			pushedNode = thisModel.getMeshNode(k);
+		}
+
+		// Bind texture set (set 1) only when the texture changes
+		if (mesh->getTexId() != boundTexId) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+				1, 1, &samplerDescriptorSets[mesh->getTexId()], 0, nullptr);
+			boundTexId = mesh->getTexId();
+			stats.bindCount++;
+		}
+		else {
+			stats.bindsSaved++;
+		}
+
+		// Bind arena index buffer, with 0 offset and using the mesh's index type
+		if (mesh->getIndexType() != boundIndexType) {
+			vkCmdBindIndexBuffer(commandBuffer, geometryArena->getIndexBuffer(), 0, mesh->getIndexType());
+			boundIndexType = mesh->getIndexType();
+			stats.bindCount++;
+		}
+		else {
+			stats.bindsSaved++;
+		}
+
+		stats.drawCount++;
+
+		// Culled mesh: the draws of its visible meshlets, as many as the cull shader counted
+		if (drawCullBatches[drawIndex] >= 0) {
+			const CullPush& push = cullPushes[drawCullBatches[drawIndex]];
+			vkCmdDrawIndexedIndirectCount(commandBuffer,
+				meshletDrawBuffer[currentImage], sizeof(VkDrawIndexedIndirectCommand) * static_cast<VkDeviceSize>(push.firstDraw),
+				meshletCountBuffer[currentImage], sizeof(uint32_t) * static_cast<VkDeviceSize>(push.countIndex),
+				push.meshletCount, sizeof(VkDrawIndexedIndirectCommand));
+			stats.drawCallCount++;
+			continue;
+		}
+
+		// Indirect: this draw and the following ones sharing its state read their parameters from the indirect buffer,
+		// which holds the image's draws in sorted order. Compact meshes each push their own dequantize matrix, so they run alone
+		if (indirectDraws) {
+			size_t runEnd = draw + 1;
+			while (runEnd < endDraw && mesh->getVertexFormat() == VertexFormat::Full) {
+				uint32_t nextIndex = DRAW_SORT::getDrawIndex(imageDrawKeys[runEnd]);
+				Mesh* nextMesh = meshList[meshDraws[nextIndex].model].getMesh(meshDraws[nextIndex].mesh);
+				if (drawCullBatches[nextIndex] >= 0 || nextMesh->getVertexFormat() != VertexFormat::Full
+					|| nextMesh->getTexId() != mesh->getTexId() || nextMesh->getIndexType() != mesh->getIndexType()) {
+					break;
+				}
+				runEnd++;
+			}
+
+			uint32_t runLength = static_cast<uint32_t>(runEnd - draw);
+			VkDeviceSize runOffset = sizeof(VkDrawIndexedIndirectCommand) * static_cast<VkDeviceSize>(draw);
+			if (drawCullPipeline != VK_NULL_HANDLE) {
+				// Frustum culled: the run's visible draws, as many as the draw cull shader counted at the run's start
+				// (late phase ones are in the second half of the draws and counts)
+				std::fill(drawRunStarts[currentImage].begin() + draw, drawRunStarts[currentImage].begin() + runEnd, static_cast<uint32_t>(draw));
+				VkDeviceSize phaseDraw = static_cast<VkDeviceSize>(phase) * MAX_DRAW_TRANSFORMS;
+				vkCmdDrawIndexedIndirectCount(commandBuffer, culledDrawBuffer[currentImage], runOffset + sizeof(VkDrawIndexedIndirectCommand) * phaseDraw,
+					culledCountBuffer[currentImage], sizeof(uint32_t) * (phaseDraw + draw),
+					runLength, sizeof(VkDrawIndexedIndirectCommand));
+				stats.drawCallCount++;
+			}
+			else if (multiDrawIndirectSupported) {
+				vkCmdDrawIndexedIndirect(commandBuffer, indirectDrawBuffer[currentImage], runOffset, runLength, sizeof(VkDrawIndexedIndirectCommand));
+				stats.drawCallCount++;
+			}
+			else {
+				// One draw per call, parameters still come from the buffer
+				for (uint32_t i = 0; i < runLength; i++) {
+					vkCmdDrawIndexedIndirect(commandBuffer, indirectDrawBuffer[currentImage], runOffset + sizeof(VkDrawIndexedIndirectCommand) * i,
+						1, sizeof(VkDrawIndexedIndirectCommand));
+				}
+				stats.drawCallCount += runLength;
+			}
+
+			// Rest of the run needed none of its binds
+			stats.drawCount += runLength - 1;
+			stats.bindsSaved += 4 * (runLength - 1);
+			draw = runEnd - 1;
+			continue;
+		}
+
+		// Execute pipeline, mesh LOD is a range of the arena buffers
+		const MeshLod& lod = mesh->getLod(meshLods[drawIndex]);
+		if (instancedTransforms) {
+			// Every copy in one draw, instance i reads transform slot firstTransform + i
+			vkCmdDrawIndexed(commandBuffer, lod.indexCount, meshDraw.instanceCount, mesh->getFirstIndex() + lod.firstIndex,
+				mesh->getVertexOffset(), meshDraw.firstTransform);
+			stats.drawCallCount++;
+			continue;
+		}
+
+		// Pushed transforms: one draw per copy
+		vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, mesh->getFirstIndex() + lod.firstIndex, mesh->getVertexOffset(), 0);
+		stats.drawCallCount += meshDraw.instanceCount;
+		for (uint32_t instance = 1; instance < meshDraw.instanceCount; instance++) {
+			glm::mat4 meshModel = getInstanceTransform(meshDraw, instance);
+			if (mesh->getVertexFormat() == VertexFormat::Compact) {
+				meshModel = meshModel * mesh->getDequantize();
+			}
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &meshModel);
+			vkCmdDrawIndexed(commandBuffer, lod.indexCount, 1, mesh->getFirstIndex() + lod.firstIndex, mesh->getVertexOffset(), 0);
+			pushedNode = -1;
+		}
+	}
+
+	// Late phase draws are the same meshes again, only its calls and binds add to the early phase's
+	if (phase == 1) {
+		stats.drawCount = 0;
+	}
+
+	return stats;
 }
 
 void Render::updateModel(int modelId, glm::mat4 newModel) {
@@ -1414,6 +2798,68 @@ void Render::updateModel(int modelId, glm::mat4 newModel) {
 	meshList[modelId].setModel(newModel);
 }
 
+void Render::updateModelNode(int modelId, uint32_t node, glm::mat4 localTransform) {
+	if (static_cast<unsigned>(modelId) >= meshList.size() || modelStatus[modelId] != ModelStatus::Ready) {
+		return;
+	}
+	meshList[modelId].setNodeTransform(node, localTransform);
+}
+
+
+int Render::createInstance(int modelId, glm::mat4 transform) {
+	if (static_cast<unsigned>(modelId) >= meshList.size()) {
+		throw std::runtime_error("Failed to create an instance, model does not exist!");
+	}
+	// Loading models are checked with their instances once they are ready
+	if (modelStatus[modelId] == ModelStatus::Ready && getTransformCount() + meshList[modelId].getMeshCount() > MAX_DRAW_TRANSFORMS) {
+		throw std::runtime_error("Failed to create an instance, transform buffer is full!");
+	}
+
+	// Reuse ids of removed instances
+	int instanceId;
+	if (!freeInstanceIds.empty()) {
+		instanceId = freeInstanceIds.back();
+		freeInstanceIds.pop_back();
+	}
+	else {
+		instanceId = static_cast<int>(instances.size());
+		instances.push_back(ModelInstance());
+	}
+
+	instances[instanceId].modelId = modelId;
+	instances[instanceId].index = static_cast<uint32_t>(modelInstances[modelId].size());
+	instances[instanceId].transform = transform;
+	modelInstances[modelId].push_back(instanceId);
+
+	// Model's draws now cover one more copy
+	invalidateCommandBuffers();
+	return instanceId;
+}
+
+void Render::updateInstance(int instanceId, glm::mat4 transform) {
+	if (static_cast<unsigned>(instanceId) >= instances.size() || instances[instanceId].modelId < 0) {
+		return;
+	}
+	instances[instanceId].transform = transform;
+}
+
+void Render::removeInstance(int instanceId) {
+	if (static_cast<unsigned>(instanceId) >= instances.size() || instances[instanceId].modelId < 0) {
+		return;
+	}
+
+	// Last instance of the model takes the removed one's place
+	std::vector<int>& ids = modelInstances[instances[instanceId].modelId];
+	uint32_t index = instances[instanceId].index;
+	ids[index] = ids.back();
+	instances[ids[index]].index = index;
+	ids.pop_back();
+
+	instances[instanceId].modelId = -1;
+	freeInstanceIds.push_back(instanceId);
+
+	invalidateCommandBuffers();
+}
 
 void Render::createTextureSampler() {
 	// Sampler Creation Info
@@ -1429,7 +2875,7 @@ void Render::createTextureSampler() {
 	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;		// Mipmap interpolation mode
 	samplerCreateInfo.mipLodBias = 0.0f;								// Level of Details bias for mip level
 	samplerCreateInfo.minLod = 0.0f;									// Minimum Level of Detail to pick mip level
-	samplerCreateInfo.maxLod = 0.0f;									// Maximum Level of Detail to pick mip level
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;						// Maximum Level of Detail to pick mip level (no limit, use the whole chain)
 	samplerCreateInfo.anisotropyEnable = VK_TRUE;						// Enable Anisotropy
 	samplerCreateInfo.maxAnisotropy = 16;								// Anisotropy sample level
 
@@ -1449,11 +2895,37 @@ void Render::createUniformBuffers() {
 	
 	// Create Uniform buffers
 	for (size_t i = 0; i < swapChainImages.size(); i++) {
-		UTILS::createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, vpBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), vpBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vpUniformBuffer[i], &vpUniformBufferMemory[i]);
 	}
 }
 
+void Render::createTransformBuffers() {
+	// Written by the CPU every frame like the VP buffer, one for each image
+	transformBuffer.resize(swapChainImages.size());
+	transformBufferMemory.resize(swapChainImages.size());
+
+	for (size_t i = 0; i < swapChainImages.size(); i++) {
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), sizeof(glm::mat4) * static_cast<VkDeviceSize>(MAX_DRAW_TRANSFORMS),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &transformBuffer[i], &transformBufferMemory[i]);
+	}
+
+	// Indirect draw parameters change with LODs every frame, so they are written by the CPU too (at most one per transform).
+	// The draw cull shader reads them as its source draws
+	if (!indirectDraws) {
+		return;
+	}
+
+	indirectDrawBuffer.resize(swapChainImages.size());
+	indirectDrawBufferMemory.resize(swapChainImages.size());
+	for (size_t i = 0; i < swapChainImages.size(); i++) {
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), sizeof(VkDrawIndexedIndirectCommand) * static_cast<VkDeviceSize>(MAX_DRAW_TRANSFORMS),
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &indirectDrawBuffer[i], &indirectDrawBufferMemory[i]);
+	}
+}
+
 void Render::createDescriptorPool() {
 
 	// CREATE UNIFORM DESCRIPTOR POOL
@@ -1574,12 +3046,475 @@ void Render::createDescriptorSets() {
 	}
 }
 
+void Render::createCullResources() {
+	// Nothing to cull with
+	if (cullPipeline == VK_NULL_HANDLE && drawCullPipeline == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// Camera data is written by the CPU every frame, both cull shaders read it
+	size_t imageCount = swapChainImages.size();
+	cullFrameBuffer.resize(imageCount);
+	cullFrameBufferMemory.resize(imageCount);
+	for (size_t i = 0; i < imageCount; i++) {
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), sizeof(CullFrame), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &cullFrameBuffer[i], &cullFrameBufferMemory[i]);
+	}
+
+	if (cullPipeline == VK_NULL_HANDLE) {
+		return;
+	}
+
+	meshletDrawBuffer.resize(imageCount);
+	meshletDrawBufferMemory.resize(imageCount);
+	meshletCountBuffer.resize(imageCount);
+	meshletCountBufferMemory.resize(imageCount);
+
+	// Draws and counts only ever live on the GPU
+	for (size_t i = 0; i < imageCount; i++) {
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), sizeof(VkDrawIndexedIndirectCommand) * static_cast<VkDeviceSize>(MAX_MESHLET_DRAWS),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &meshletDrawBuffer[i], &meshletDrawBufferMemory[i]);
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), sizeof(uint32_t) * static_cast<VkDeviceSize>(MAX_CULLED_MESHES),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &meshletCountBuffer[i], &meshletCountBufferMemory[i]);
+	}
+
+	// CREATE CULL DESCRIPTOR POOL
+	VkDescriptorPoolSize cullUniformPoolSize = {};
+	cullUniformPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	cullUniformPoolSize.descriptorCount = static_cast<uint32_t>(imageCount);
+
+	VkDescriptorPoolSize cullStoragePoolSize = {};
+	cullStoragePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	cullStoragePoolSize.descriptorCount = static_cast<uint32_t>(imageCount * 4);
+
+	std::vector<VkDescriptorPoolSize> cullPoolSizes = {cullUniformPoolSize, cullStoragePoolSize};
+
+	VkDescriptorPoolCreateInfo cullPoolCreateInfo = {};
+	cullPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	cullPoolCreateInfo.maxSets = static_cast<uint32_t>(imageCount);
+	cullPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(cullPoolSizes.size());
+	cullPoolCreateInfo.pPoolSizes = cullPoolSizes.data();
+
+	VkResult result = vkCreateDescriptorPool(mainDevice.logicalDevice, &cullPoolCreateInfo, nullptr, &cullDescriptorPool);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Descriptor Pool!");
+	}
+
+	// CREATE CULL DESCRIPTOR SETS
+	cullDescriptorSets.resize(imageCount);
+	std::vector<VkDescriptorSetLayout> setLayouts(imageCount, cullSetLayout);
+
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = cullDescriptorPool;
+	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(imageCount);
+	setAllocInfo.pSetLayouts = setLayouts.data();
+
+	result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, cullDescriptorSets.data());
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate Descriptor Sets!");
+	}
+
+	for (size_t i = 0; i < imageCount; i++) {
+		// Binding order matches Shaders/cull.comp
+		std::array<VkDescriptorBufferInfo, 5> bufferInfos = {};
+		bufferInfos[0].buffer = cullFrameBuffer[i];
+		bufferInfos[0].range = sizeof(CullFrame);
+		bufferInfos[1].buffer = geometryArena->getMeshletBuffer();
+		bufferInfos[1].range = VK_WHOLE_SIZE;
+		bufferInfos[2].buffer = meshletDrawBuffer[i];
+		bufferInfos[2].range = VK_WHOLE_SIZE;
+		bufferInfos[3].buffer = meshletCountBuffer[i];
+		bufferInfos[3].range = VK_WHOLE_SIZE;
+		bufferInfos[4].buffer = transformBuffer[i];
+		bufferInfos[4].range = VK_WHOLE_SIZE;
+
+		std::array<VkWriteDescriptorSet, 5> setWrites = {};
+		for (size_t j = 0; j < setWrites.size(); j++) {
+			setWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			setWrites[j].dstSet = cullDescriptorSets[i];
+			setWrites[j].dstBinding = static_cast<uint32_t>(j);
+			setWrites[j].dstArrayElement = 0;
+			setWrites[j].descriptorType = j == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			setWrites[j].descriptorCount = 1;
+			setWrites[j].pBufferInfo = &bufferInfos[j];
+		}
+
+		vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+	}
+}
+
+void Render::createDepthPyramid() {
+	// The draw cull shader reads the pyramid even when occlusion culling is off (it just never tests against it)
+	if (drawCullPipeline == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// Largest power of two that fits in the swapchain extent, so every further level halves exactly
+	depthPyramidWidth = 1;
+	while (depthPyramidWidth * 2 <= swapChainExtent.width) {
+		depthPyramidWidth *= 2;
+	}
+	depthPyramidHeight = 1;
+	while (depthPyramidHeight * 2 <= swapChainExtent.height) {
+		depthPyramidHeight *= 2;
+	}
+	depthPyramidLevels = 1;
+	while ((std::max(depthPyramidWidth, depthPyramidHeight) >> depthPyramidLevels) > 0) {
+		depthPyramidLevels++;
+	}
+
+	depthPyramidImage = createImage(depthPyramidWidth, depthPyramidHeight, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&depthPyramidImageMemory, depthPyramidLevels);
+	depthPyramidImageView = createImageView(depthPyramidImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, depthPyramidLevels);
+	depthPyramidLevelViews.resize(depthPyramidLevels);
+	for (uint32_t level = 0; level < depthPyramidLevels; level++) {
+		depthPyramidLevelViews[level] = createImageView(depthPyramidImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1, level);
+	}
+
+	// Texels are fetched by index, so nothing is filtered
+	VkSamplerCreateInfo samplerCreateInfo = {};
+	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCreateInfo.minLod = 0.0f;
+	samplerCreateInfo.maxLod = static_cast<float>(depthPyramidLevels);
+
+	VkResult result = vkCreateSampler(mainDevice.logicalDevice, &samplerCreateInfo, nullptr, &depthPyramidSampler);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Depth Pyramid Sampler!");
+	}
+
+	// Pyramid stays in GENERAL layout (written and read by compute), starting at the far plane so nothing is hidden
+	// until the first frame has built it
+	VkCommandBuffer commandBuffer = UTILS::beginCommandBuffer(mainDevice.logicalDevice, graphicsCommandPool);
+
+	VkImageMemoryBarrier generalBarrier = {};
+	generalBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	generalBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	generalBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	generalBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	generalBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	generalBarrier.image = depthPyramidImage;
+	generalBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	generalBarrier.subresourceRange.baseMipLevel = 0;
+	generalBarrier.subresourceRange.levelCount = depthPyramidLevels;
+	generalBarrier.subresourceRange.baseArrayLayer = 0;
+	generalBarrier.subresourceRange.layerCount = 1;
+	generalBarrier.srcAccessMask = 0;
+	generalBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &generalBarrier);
+
+	VkClearColorValue farDepth = {};
+	farDepth.float32[0] = 1.0f;
+	vkCmdClearColorImage(commandBuffer, depthPyramidImage, VK_IMAGE_LAYOUT_GENERAL, &farDepth, 1, &generalBarrier.subresourceRange);
+
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	vkQueueWaitIdle(graphicsQueue);
+	vkFreeCommandBuffers(mainDevice.logicalDevice, graphicsCommandPool, 1, &commandBuffer);
+
+	// Nothing builds it
+	if (depthPyramidPipeline == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// CREATE DEPTH PYRAMID DESCRIPTOR POOL
+	// Level 0 is built from the image's own depth buffer, the other levels are the same for every image
+	uint32_t pyramidSetCount = static_cast<uint32_t>(swapChainImages.size()) + depthPyramidLevels - 1;
+
+	VkDescriptorPoolSize pyramidSamplerPoolSize = {};
+	pyramidSamplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pyramidSamplerPoolSize.descriptorCount = pyramidSetCount;
+
+	VkDescriptorPoolSize pyramidStoragePoolSize = {};
+	pyramidStoragePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	pyramidStoragePoolSize.descriptorCount = pyramidSetCount;
+
+	std::vector<VkDescriptorPoolSize> pyramidPoolSizes = {pyramidSamplerPoolSize, pyramidStoragePoolSize};
+
+	VkDescriptorPoolCreateInfo pyramidPoolCreateInfo = {};
+	pyramidPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pyramidPoolCreateInfo.maxSets = pyramidSetCount;
+	pyramidPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(pyramidPoolSizes.size());
+	pyramidPoolCreateInfo.pPoolSizes = pyramidPoolSizes.data();
+
+	result = vkCreateDescriptorPool(mainDevice.logicalDevice, &pyramidPoolCreateInfo, nullptr, &depthPyramidDescriptorPool);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Descriptor Pool!");
+	}
+
+	// CREATE DEPTH PYRAMID DESCRIPTOR SETS
+	depthPyramidDescriptorSets.resize(pyramidSetCount);
+	std::vector<VkDescriptorSetLayout> setLayouts(pyramidSetCount, depthPyramidSetLayout);
+
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = depthPyramidDescriptorPool;
+	setAllocInfo.descriptorSetCount = pyramidSetCount;
+	setAllocInfo.pSetLayouts = setLayouts.data();
+
+	result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, depthPyramidDescriptorSets.data());
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate Descriptor Sets!");
+	}
+
+	for (uint32_t i = 0; i < pyramidSetCount; i++) {
+		// Depth buffer is read in the layout the early render pass leaves it in
+		uint32_t level = i < swapChainImages.size() ? 0 : i - static_cast<uint32_t>(swapChainImages.size()) + 1;
+		VkDescriptorImageInfo sourceInfo = {};
+		sourceInfo.sampler = depthPyramidSampler;
+		sourceInfo.imageView = level == 0 ? depthBufferImageView[i] : depthPyramidLevelViews[level - 1];
+		sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo destinationInfo = {};
+		destinationInfo.imageView = depthPyramidLevelViews[level];
+		destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> setWrites = {};
+		for (size_t j = 0; j < setWrites.size(); j++) {
+			setWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			setWrites[j].dstSet = depthPyramidDescriptorSets[i];
+			setWrites[j].dstBinding = static_cast<uint32_t>(j);
+			setWrites[j].dstArrayElement = 0;
+			setWrites[j].descriptorType = j == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			setWrites[j].descriptorCount = 1;
+			setWrites[j].pImageInfo = j == 0 ? &sourceInfo : &destinationInfo;
+		}
+
+		vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+	}
+}
+
+void Render::createDrawCullResources() {
+	// Nothing to cull with
+	if (drawCullPipeline == VK_NULL_HANDLE) {
+		return;
+	}
+
+	size_t imageCount = swapChainImages.size();
+	drawCullInfoBuffer.resize(imageCount);
+	drawCullInfoBufferMemory.resize(imageCount);
+	culledDrawBuffer.resize(imageCount);
+	culledDrawBufferMemory.resize(imageCount);
+	culledCountBuffer.resize(imageCount);
+	culledCountBufferMemory.resize(imageCount);
+	cullStatsBuffer.resize(imageCount);
+	cullStatsBufferMemory.resize(imageCount);
+	occludedDrawBuffer.resize(imageCount);
+	occludedDrawBufferMemory.resize(imageCount);
+	drawRunStarts.resize(imageCount);
+
+	// Draw infos are written by the CPU every frame and stats read back by it, draws and counts only ever live on the GPU.
+	// Every buffer holds at most one entry per sorted draw (draws and counts twice with occlusion culling, the late
+	// phase writes the second half)
+	VkDeviceSize phaseCount = depthPyramidPipeline != VK_NULL_HANDLE ? 2 : 1;
+	for (size_t i = 0; i < imageCount; i++) {
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), sizeof(DrawCullInfo) * static_cast<VkDeviceSize>(MAX_DRAW_TRANSFORMS),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &drawCullInfoBuffer[i], &drawCullInfoBufferMemory[i]);
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), sizeof(VkDrawIndexedIndirectCommand) * phaseCount * static_cast<VkDeviceSize>(MAX_DRAW_TRANSFORMS),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &culledDrawBuffer[i], &culledDrawBufferMemory[i]);
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), sizeof(uint32_t) * phaseCount * static_cast<VkDeviceSize>(MAX_DRAW_TRANSFORMS),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &culledCountBuffer[i], &culledCountBufferMemory[i]);
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), sizeof(uint32_t) * static_cast<VkDeviceSize>(MAX_DRAW_TRANSFORMS),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &occludedDrawBuffer[i], &occludedDrawBufferMemory[i]);
+		// Visible, culled and occluded counts as the shader writes them
+		UTILS::createBuffer(mainDevice.logicalDevice, memoryAllocator.get(), CULL_STATS_SIZE,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &cullStatsBuffer[i], &cullStatsBufferMemory[i]);
+		memset(cullStatsBufferMemory[i].mapped, 0, CULL_STATS_SIZE);
+	}
+
+	// CREATE DRAW CULL DESCRIPTOR POOL
+	VkDescriptorPoolSize drawCullUniformPoolSize = {};
+	drawCullUniformPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	drawCullUniformPoolSize.descriptorCount = static_cast<uint32_t>(imageCount);
+
+	VkDescriptorPoolSize drawCullStoragePoolSize = {};
+	drawCullStoragePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	drawCullStoragePoolSize.descriptorCount = static_cast<uint32_t>(imageCount * 7);
+
+	VkDescriptorPoolSize drawCullSamplerPoolSize = {};
+	drawCullSamplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	drawCullSamplerPoolSize.descriptorCount = static_cast<uint32_t>(imageCount);
+
+	std::vector<VkDescriptorPoolSize> drawCullPoolSizes = {drawCullUniformPoolSize, drawCullStoragePoolSize, drawCullSamplerPoolSize};
+
+	VkDescriptorPoolCreateInfo drawCullPoolCreateInfo = {};
+	drawCullPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	drawCullPoolCreateInfo.maxSets = static_cast<uint32_t>(imageCount);
+	drawCullPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(drawCullPoolSizes.size());
+	drawCullPoolCreateInfo.pPoolSizes = drawCullPoolSizes.data();
+
+	VkResult result = vkCreateDescriptorPool(mainDevice.logicalDevice, &drawCullPoolCreateInfo, nullptr, &drawCullDescriptorPool);
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create a Descriptor Pool!");
+	}
+
+	// CREATE DRAW CULL DESCRIPTOR SETS
+	drawCullDescriptorSets.resize(imageCount);
+	std::vector<VkDescriptorSetLayout> setLayouts(imageCount, drawCullSetLayout);
+
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = drawCullDescriptorPool;
+	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(imageCount);
+	setAllocInfo.pSetLayouts = setLayouts.data();
+
+	result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &setAllocInfo, drawCullDescriptorSets.data());
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate Descriptor Sets!");
+	}
+
+	for (size_t i = 0; i < imageCount; i++) {
+		// Binding order matches Shaders/draw_cull.comp
+		std::array<VkDescriptorBufferInfo, 9> bufferInfos = {};
+		bufferInfos[0].buffer = cullFrameBuffer[i];
+		bufferInfos[0].range = sizeof(CullFrame);
+		bufferInfos[1].buffer = indirectDrawBuffer[i];
+		bufferInfos[1].range = VK_WHOLE_SIZE;
+		bufferInfos[2].buffer = drawCullInfoBuffer[i];
+		bufferInfos[2].range = VK_WHOLE_SIZE;
+		bufferInfos[3].buffer = transformBuffer[i];
+		bufferInfos[3].range = VK_WHOLE_SIZE;
+		bufferInfos[4].buffer = culledDrawBuffer[i];
+		bufferInfos[4].range = VK_WHOLE_SIZE;
+		bufferInfos[5].buffer = culledCountBuffer[i];
+		bufferInfos[5].range = VK_WHOLE_SIZE;
+		bufferInfos[6].buffer = cullStatsBuffer[i];
+		bufferInfos[6].range = CULL_STATS_SIZE;
+		bufferInfos[8].buffer = occludedDrawBuffer[i];
+		bufferInfos[8].range = VK_WHOLE_SIZE;
+
+		// Whole pyramid, in the layout it always stays in
+		VkDescriptorImageInfo pyramidInfo = {};
+		pyramidInfo.sampler = depthPyramidSampler;
+		pyramidInfo.imageView = depthPyramidImageView;
+		pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 9> setWrites = {};
+		for (size_t j = 0; j < setWrites.size(); j++) {
+			setWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			setWrites[j].dstSet = drawCullDescriptorSets[i];
+			setWrites[j].dstBinding = static_cast<uint32_t>(j);
+			setWrites[j].dstArrayElement = 0;
+			setWrites[j].descriptorType = j == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+				: j == 7 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			setWrites[j].descriptorCount = 1;
+			if (j == 7) {
+				setWrites[j].pImageInfo = &pyramidInfo;
+			}
+			else {
+				setWrites[j].pBufferInfo = &bufferInfos[j];
+			}
+		}
+
+		vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+	}
+}
+
 void Render::updateUniformBuffers(uint32_t imageIndex) {
-	// Copy VP data
-	void* data;
-	vkMapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex], 0, sizeof(UboViewProjection), 0, &data);
-	memcpy(data, &uboViewProjection, sizeof(UboViewProjection));
-	vkUnmapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex]);
+	// Copy VP data (uniform buffer memory is persistently mapped by the allocator)
+	memcpy(vpUniformBufferMemory[imageIndex].mapped, &uboViewProjection, sizeof(UboViewProjection));
+
+	// Mesh transforms to the slots selectMeshLods gave them, recorded draws and culls read them from here
+	glm::mat4* transforms = static_cast<glm::mat4*>(transformBufferMemory[imageIndex].mapped);
+	uint32_t drawLimit = getDrawLimit();
+	for (size_t j = 0; j < meshList.size(); j++) {
+		if (modelStatus[j] != ModelStatus::Ready) {
+			continue;
+		}
+
+		for (uint32_t drawIndex = modelFirstDraw[j]; drawIndex < modelFirstDraw[j] + meshList[j].getMeshCount() && drawIndex < drawLimit; drawIndex++) {
+			const MeshDraw& meshDraw = meshDraws[drawIndex];
+			for (uint32_t instance = 0; instance < meshDraw.instanceCount; instance++) {
+				transforms[meshDraw.firstTransform + instance] = getInstanceTransform(meshDraw, instance);
+			}
+		}
+	}
+
+	// Indirect draw parameters in the order this image's draws were recorded in, with this frame's LODs
+	if (indirectDraws) {
+		VkDrawIndexedIndirectCommand* drawCommands = static_cast<VkDrawIndexedIndirectCommand*>(indirectDrawBufferMemory[imageIndex].mapped);
+		const std::vector<uint64_t>& imageDrawKeys = drawKeys[imageIndex];
+		for (size_t draw = 0; draw < imageDrawKeys.size(); draw++) {
+			uint32_t drawIndex = DRAW_SORT::getDrawIndex(imageDrawKeys[draw]);
+			const MeshDraw& meshDraw = meshDraws[drawIndex];
+			Mesh* mesh = meshList[meshDraw.model].getMesh(meshDraw.mesh);
+			const MeshLod& lod = mesh->getLod(meshLods[drawIndex]);
+
+			drawCommands[draw].indexCount = lod.indexCount;
+			drawCommands[draw].instanceCount = meshDraw.instanceCount;
+			drawCommands[draw].firstIndex = mesh->getFirstIndex() + lod.firstIndex;
+			drawCommands[draw].vertexOffset = mesh->getVertexOffset();
+			drawCommands[draw].firstInstance = meshDraw.firstTransform;
+		}
+	}
+
+	// Bounds of the same draws for the draw cull shader, and the stats it wrote the last time this image was drawn
+	if (drawCullPipeline != VK_NULL_HANDLE) {
+		DrawCullInfo* drawInfos = static_cast<DrawCullInfo*>(drawCullInfoBufferMemory[imageIndex].mapped);
+		const std::vector<uint64_t>& imageDrawKeys = drawKeys[imageIndex];
+		const std::vector<uint32_t>& imageRunStarts = drawRunStarts[imageIndex];
+		for (size_t draw = 0; draw < imageDrawKeys.size(); draw++) {
+			const MeshDraw& meshDraw = meshDraws[DRAW_SORT::getDrawIndex(imageDrawKeys[draw])];
+			Mesh* mesh = meshList[meshDraw.model].getMesh(meshDraw.mesh);
+
+			drawInfos[draw].sphere = glm::vec4(mesh->getBoundsCenter(), mesh->getBoundsRadius());
+			drawInfos[draw].runStart = imageRunStarts[draw];
+		}
+
+		const uint32_t* statCounts = static_cast<const uint32_t*>(cullStatsBufferMemory[imageIndex].mapped);
+		cullStats = CullStats();
+		cullStats.visibleCount = statCounts[0];
+		cullStats.culledCount = statCounts[1];
+		cullStats.occludedCount = statCounts[2];
+	}
+
+	// Frustum planes and camera for the cull shaders
+	if (!cullFrameBufferMemory.empty()) {
+		CullFrame cullFrame;
+		FRUSTUM_CULL::getFrustumPlanes(uboViewProjection.projection * uboViewProjection.view, cullFrame.planes);
+		cullFrame.cameraPosition = glm::vec4(glm::vec3(glm::inverse(uboViewProjection.view)[3]), 1.0f);
+
+		// Early phase tests against the pyramid the previous frame built with its own camera, the late phase
+		// against the one this frame builds
+		glm::mat4 viewProjection = uboViewProjection.projection * uboViewProjection.view;
+		cullFrame.viewProjection = viewProjection;
+		cullFrame.previousViewProjection = previousViewProjection;
+		cullFrame.depthPyramid = glm::vec4(static_cast<float>(depthPyramidWidth), static_cast<float>(depthPyramidHeight),
+			static_cast<float>(depthPyramidLevels), depthPyramidBuilt ? 1.0f : 0.0f);
+		previousViewProjection = viewProjection;
+		depthPyramidBuilt = depthPyramidPipeline != VK_NULL_HANDLE;
+
+		memcpy(cullFrameBufferMemory[imageIndex].mapped, &cullFrame, sizeof(CullFrame));
+	}
 }
 
 void Render::createDepthBufferImage() {
@@ -1595,8 +3530,13 @@ void Render::createDepthBufferImage() {
 
 	for (size_t i = 0; i < swapChainImages.size(); i++) {
 		// Create Depth Buffer Image
+		// (also sampled when the depth pyramid is built from it)
+		VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+		if (depthPyramidPipeline != VK_NULL_HANDLE) {
+			depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+		}
 		depthBufferImage[i] = createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthBufferImageMemory[i]);
+			depthUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthBufferImageMemory[i]);
 
 		// Create Depth Buffer Image View
 		depthBufferImageView[i] = createImageView(depthBufferImage[i], depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
@@ -1623,7 +3563,7 @@ VkFormat Render::chooseSupportedFormat(const std::vector<VkFormat>& formats, VkI
 }
 
 
-VkImage Render::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory) {
+VkImage Render::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, MemoryAllocation* imageMemory, uint32_t mipLevels) {
 	// CREATE IMAGE
 	// Image Creation Info
 	VkImageCreateInfo imageCreateInfo = {};
@@ -1632,7 +3572,7 @@ VkImage Render::createImage(uint32_t width, uint32_t height, VkFormat format, Vk
 	imageCreateInfo.extent.width = width;								// Width of image extent
 	imageCreateInfo.extent.height = height;								// Height of image extent
 	imageCreateInfo.extent.depth = 1;									// Depth of image (just 1, no 3D aspect)
-	imageCreateInfo.mipLevels = 1;										// Number of mipmap levels
+	imageCreateInfo.mipLevels = mipLevels;								// Number of mipmap levels
 	imageCreateInfo.arrayLayers = 1;									// Number of levels in image array
 	imageCreateInfo.format = format;									// Format type of image
 	imageCreateInfo.tiling = tiling;									// How image data should be "tiled" (arranged for optimal reading)
@@ -1654,75 +3594,77 @@ VkImage Render::createImage(uint32_t width, uint32_t height, VkFormat format, Vk
 	VkMemoryRequirements memoryRequirements;
 	vkGetImageMemoryRequirements(mainDevice.logicalDevice, image, &memoryRequirements);
 
-	// Allocate memory using image requirements and user defined properties
-	VkMemoryAllocateInfo memoryAllocInfo = {};
-	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocInfo.allocationSize = memoryRequirements.size;
-	memoryAllocInfo.memoryTypeIndex = UTILS::findMemoryTypeIndex(mainDevice.physicalDevice, memoryRequirements.memoryTypeBits, propFlags);
-
-	result = vkAllocateMemory(mainDevice.logicalDevice, &memoryAllocInfo, nullptr, imageMemory);
-	if (result != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate memory for image!");
-	}
+	// Get region of pooled memory using image requirements and user defined properties
+	*imageMemory = memoryAllocator->allocate(memoryRequirements, propFlags, tiling == VK_IMAGE_TILING_LINEAR);
 
 	// Connect memory to image
-	vkBindImageMemory(mainDevice.logicalDevice, image, *imageMemory, 0);
+	vkBindImageMemory(mainDevice.logicalDevice, image, imageMemory->memory, imageMemory->offset);
 
 	return image;
 }
 
 
 int Render::createTextureImage(std::string fileName) {
+	// Upload on its own batch and wait, used for textures needed straight away
+	UploadBatch uploadBatch(&uploadContext);
+	MemoryAllocation texImageMemory;
+	uint32_t mipLevels;
+	VkImage texImage = stageTextureImage(fileName, &uploadBatch, &texImageMemory, &mipLevels);
+
+	uploadBatch.submit();
+	uploadWaitValue = std::max(uploadWaitValue, uploadBatch.getCompleteValue());
+	uploadBatch.wait();
+
+	// Add texture data to vector for reference
+	textureImages.push_back(texImage);
+	textureImageMemory.push_back(texImageMemory);
+	textureMipLevels.push_back(mipLevels);
+
+	// Return index of new texture image
+	return textureImages.size() - 1;
+}
+
+VkImage Render::stageTextureImage(std::string fileName, UploadBatch* uploadBatch, MemoryAllocation* imageMemory, uint32_t* mipLevels) {
 	// Load image file
 	int width, height;
 	VkDeviceSize imageSize;
 	stbi_uc* imageData = loadTextureFile(fileName, &width, &height, &imageSize);
 
-	// Create staging buffer to hold loaded data, ready to copy to device
-	VkBuffer imageStagingBuffer;
-	VkDeviceMemory imageStagingBufferMemory;
-	UTILS::createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-	                    &imageStagingBuffer, &imageStagingBufferMemory);
-
-	// Copy image data to staging buffer
-	void* data;
-	vkMapMemory(mainDevice.logicalDevice, imageStagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, imageData, static_cast<size_t>(imageSize));
-	vkUnmapMemory(mainDevice.logicalDevice, imageStagingBufferMemory);
+	VkImage texImage = stageTexturePixels(imageData, width, height, imageSize, uploadBatch, imageMemory, mipLevels);
 
 	// Free original image data
 	stbi_image_free(imageData);
 
-	// Create image to hold final texture
-	VkImage texImage;
-	VkDeviceMemory texImageMemory;
-	texImage = createImage(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texImageMemory);
-
-
-	// COPY DATA TO IMAGE
-	// Transition image to be DST for copy operation
-	UTILS::transitionImageLayout(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool,
-	                             texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	return texImage;
+}
 
-	// Copy image data
-	UTILS::copyImageBuffer(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, imageStagingBuffer, texImage, width, height);
+VkImage Render::stageTexturePixels(stbi_uc* imageData, int width, int height, VkDeviceSize imageSize,
+	UploadBatch* uploadBatch, MemoryAllocation* imageMemory, uint32_t* mipLevels) {
+	// Full chain down to 1x1
+	*mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
 
-	// Transition image to be shader readable for shader usage
-	UTILS::transitionImageLayout(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool,
-	                             texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	// Mips can be blitted on the GPU only if the format supports linear filtered blits
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(mainDevice.physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+	VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	bool generateMipmaps = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
 
-	// Add texture data to vector for reference
-	textureImages.push_back(texImage);
-	textureImageMemory.push_back(texImageMemory);
+	// Create image to hold final texture (TRANSFER_SRC so levels can be blitted from each other)
+	VkImage texImage = createImage(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		imageMemory, *mipLevels);
 
-	// Destroy staging buffers
-	vkDestroyBuffer(mainDevice.logicalDevice, imageStagingBuffer, nullptr);
-	vkFreeMemory(mainDevice.logicalDevice, imageStagingBufferMemory, nullptr);
+	// COPY DATA TO IMAGE
+	// Pixels are staged straight away, layout transitions and ownership transfer are recorded by the batch
+	if (generateMipmaps) {
+		uploadBatch->uploadImage(texImage, width, height, *mipLevels, true, imageData, imageSize);
+	}
+	else {
+		std::vector<stbi_uc> mipChain = buildMipChain(imageData, width, height, *mipLevels);
+		uploadBatch->uploadImage(texImage, width, height, *mipLevels, false, mipChain.data(), mipChain.size());
+	}
 
-	// Return index of new texture image
-	return textureImages.size() - 1;
+	return texImage;
 }
 
 int Render::createTexture(std::string fileName) {
@@ -1730,7 +3672,8 @@ int Render::createTexture(std::string fileName) {
 	int textureImageLoc = createTextureImage(fileName);
 
 	// Create Image View and add to list
-	VkImageView imageView = createImageView(textureImages[textureImageLoc], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+	VkImageView imageView = createImageView(textureImages[textureImageLoc], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT,
+		textureMipLevels[textureImageLoc]);
 	textureImageViews.push_back(imageView);
 
 	// Create Texture Descriptor
@@ -1783,41 +3726,408 @@ int Render::createTextureDescriptor(VkImageView textureImage) {
 }
 
 
-int Render::createMeshModel(std::string modelFile) {
-	// Import model "scene"
-	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(modelFile, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
-	if (!scene) {
-		throw std::runtime_error("Failed to load model! (" + modelFile + ")");
+int Render::createMeshModel(std::string modelFile, ModelLoadOptions options) {
+	// Reserve model slot, filled once upload is finished
+	int modelId = static_cast<int>(meshList.size());
+	meshList.push_back(MeshModel(std::vector<Mesh>()));
+	modelStatus.push_back(ModelStatus::Pending);
+	modelInstances.push_back(std::vector<int>());
+
+	ModelLoad load;
+	load.modelId = modelId;
+	load.modelFile = modelFile;
+	load.options = options;
+
+	// Same steps loader threads run, but on this thread and waiting for the GPU
+	loadModel(&load);
+	if (load.failed) {
+		destroyModelLoad(&load);
+		modelStatus[modelId] = ModelStatus::Failed;
+		throw std::runtime_error(load.error);
+	}
+
+	load.uploadBatch->submit();
+	load.uploadBatch->wait();
+	finishModelLoad(&load);
+	if (load.failed) {
+		destroyModelLoad(&load);
+		modelStatus[modelId] = ModelStatus::Failed;
+		throw std::runtime_error(load.error);
+	}
+
+	return modelId;
+}
+
+int Render::createMeshModelAsync(std::string modelFile, ModelLoadOptions options) {
+	// Reserve model slot now, so id can be used (e.g. updateModel) while loading
+	int modelId = static_cast<int>(meshList.size());
+	meshList.push_back(MeshModel(std::vector<Mesh>()));
+	modelStatus.push_back(ModelStatus::Pending);
+	modelInstances.push_back(std::vector<int>());
+
+	modelLoads.push_back(std::make_unique<ModelLoad>());
+	ModelLoad* load = modelLoads.back().get();
+	load->modelId = modelId;
+	load->modelFile = modelFile;
+	load->options = options;
+
+	// Load lives in modelLoads until finished, so pointer stays valid for the worker
+	loadPool->enqueue([this, load] {
+		loadModel(load);
+	});
+
+	return modelId;
+}
+
+ModelStatus Render::getModelStatus(int modelId) {
+	if (static_cast<unsigned>(modelId) >= modelStatus.size()) {
+		return ModelStatus::Failed;
 	}
+	return modelStatus[modelId];
+}
 
-	// Get vector of all materials with 1:1 ID placement
-	std::vector<std::string> textureNames = MeshModel::LoadMaterials(scene);
+void Render::loadModel(ModelLoad* load) {
+	// Can run on any thread: only touches the allocator, geometry arena and its own batch (no queue submits)
+	try {
+		uint32_t importFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices;
+		uint32_t processFlags = (load->options.optimizeMeshes ? MESH_PROCESS_OPTIMIZE : 0)
+			| (load->options.generateLods ? MESH_PROCESS_LODS : 0)
+			| (load->options.buildMeshlets && cullPipeline != VK_NULL_HANDLE ? MESH_PROCESS_MESHLETS : 0);
+
+		// Meshlets are only dropped when the device can't draw them, a missing shader fails the load
+		bool meshletsSupported = drawIndirectCountSupported && drawIndirectFirstInstanceSupported;
+		if (load->options.buildMeshlets && meshletsSupported && cullPipeline == VK_NULL_HANDLE) {
+			throw std::runtime_error("Failed to load a model with meshlets, Shaders/cull_comp.spv not found (run compile_shaders.bat)!");
+		}
+
+		// Compact vertices can only be drawn if their pipeline exists
+		VertexFormat vertexFormat = load->options.vertexFormat;
+		if (vertexFormat == VertexFormat::Compact && getMeshPipeline(VertexFormat::Compact) == VK_NULL_HANDLE) {
+			throw std::runtime_error("Failed to load a model with compact vertices, Shaders/compact_vert.spv or compact_instanced_vert.spv not found (run compile_shaders.bat)!");
+		}
 
-	// Conversion from the materials list IDs to our Descriptor Array IDs
-	std::vector<int> matToTex(textureNames.size());
+		// Geometry converted on an earlier run can be used straight from the mapped cache file
+		MeshCache cache;
+		if (cache.open(load->modelFile, importFlags, processFlags)) {
+			load->uploadBatch = std::make_unique<UploadBatch>(&uploadContext);
+			stageModelTextures(load, cache.getTextureFiles());
+			load->nodes = cache.getNodes();
+
+			for (auto& cachedMesh : cache.getMeshes()) {
+				load->meshes.push_back(Mesh(geometryArena.get(), load->uploadBatch.get(), mainDevice.logicalDevice,
+					cachedMesh.vertices, cachedMesh.vertexCount, cachedMesh.indices, cachedMesh.indexCount, cachedMesh.texId, vertexFormat,
+					cachedMesh.lods, cachedMesh.lodCount, cachedMesh.meshlets, cachedMesh.meshletCount));
+				load->meshNodes.push_back(cachedMesh.node);
+			}
 
-	// Loop over textureNames and create textures for them
-	for (size_t i = 0; i < textureNames.size(); i++) {
-		// If material had no texture, set '0' to indicate no texture, texture 0 will be reserved for a default texture
-		if (textureNames[i].empty()) {
-			matToTex[i] = 0;
+			load->staged.store(true);
+			return;
 		}
-		else {
-			// Otherwise, create texture and set value to index of new texture
-			matToTex[i] = createTexture(textureNames[i]);
+
+		// Import model "scene"
+		Assimp::Importer importer;
+		const aiScene* scene = importer.ReadFile(load->modelFile, importFlags);
+		if (!scene) {
+			throw std::runtime_error("Failed to load model! (" + load->modelFile + ")");
+		}
+
+		// Get vector of all materials with 1:1 ID placement
+		std::vector<std::string> textureNames = MeshModel::LoadMaterials(scene);
+
+		// Everything for the model (textures and meshes) goes into one batch
+		load->uploadBatch = std::make_unique<UploadBatch>(&uploadContext);
+
+		// Conversion from the materials list IDs to images of this load
+		std::vector<int> matToTex(textureNames.size());
+
+		// Materials often share a texture file, only decode and upload each file once
+		std::map<std::string, int> fileToTex;
+		std::vector<std::string> textureFiles;
+
+		for (size_t i = 0; i < textureNames.size(); i++) {
+			// If material had no texture, set '-1' so the default texture (descriptor 0) is used
+			if (textureNames[i].empty()) {
+				matToTex[i] = -1;
+				continue;
+			}
+
+			// Otherwise, set value to index of the file's image
+			if (!fileToTex.count(textureNames[i])) {
+				fileToTex[textureNames[i]] = static_cast<int>(textureFiles.size());
+				textureFiles.push_back(textureNames[i]);
+			}
+			matToTex[i] = fileToTex[textureNames[i]];
+		}
+
+		// Decode all files in parallel, all barriers and copies end up in the one batch
+		stageModelTextures(load, textureFiles);
+
+		// Convert all our meshes (spread over the decode workers, this thread helps out)
+		auto convertStart = std::chrono::steady_clock::now();
+		std::vector<MeshData> meshData = MeshModel::LoadNode(scene->mRootNode, scene, matToTex, &load->nodes, decodePool.get());
+		double convertMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - convertStart).count();
+		if (logModelLoads) {
+			std::cout << "Converted " << meshData.size() << " meshes of " << load->modelFile << " in " << convertMs << " ms" << std::endl;
+		}
+
+		// Reorder for post-transform cache, overdraw and vertex fetch (each mesh on its own)
+		if (processFlags & MESH_PROCESS_OPTIMIZE) {
+			// Cache stats are only simulated when they get printed
+			std::vector<VertexCacheStats> before(meshData.size());
+			std::vector<VertexCacheStats> after(meshData.size());
+			decodePool->parallelFor(meshData.size(), [&](size_t i) {
+				MESH_OPTIMIZER::optimizeMesh(meshData[i], logModelLoads ? &before[i] : nullptr, logModelLoads ? &after[i] : nullptr);
+			});
+
+			// Whole model stats, meshes weighted by their size
+			uint32_t triangles = 0, vertices = 0, missesBefore = 0, missesAfter = 0;
+			for (size_t i = 0; i < meshData.size(); i++) {
+				triangles += before[i].triangleCount;
+				vertices += before[i].vertexCount;
+				missesBefore += before[i].misses;
+				missesAfter += after[i].misses;
+			}
+			if (logModelLoads && triangles > 0 && vertices > 0) {
+				std::cout << "Optimized meshes of " << load->modelFile
+					<< ": ACMR " << static_cast<float>(missesBefore) / triangles << " -> " << static_cast<float>(missesAfter) / triangles
+					<< ", ATVR " << static_cast<float>(missesBefore) / vertices << " -> " << static_cast<float>(missesAfter) / vertices
+					<< " (FIFO cache of " << VERTEX_CACHE_STATS_SIZE << ")" << std::endl;
+			}
+		}
+
+		// Simplified detail levels, picked per frame from the model's size on screen
+		if (processFlags & MESH_PROCESS_LODS) {
+			decodePool->parallelFor(meshData.size(), [&](size_t i) {
+				MESH_OPTIMIZER::generateLods(meshData[i]);
+			});
+
+			if (logModelLoads) {
+				size_t levels = 0;
+				for (auto& data : meshData) {
+					levels += data.lods.size();
+				}
+				std::cout << "Generated " << levels << " detail levels for " << meshData.size() << " meshes of " << load->modelFile << std::endl;
+			}
+		}
+
+		// Clusters of the full detail level, culled on the GPU every frame
+		if (processFlags & MESH_PROCESS_MESHLETS) {
+			decodePool->parallelFor(meshData.size(), [&](size_t i) {
+				MESH_OPTIMIZER::buildMeshlets(meshData[i]);
+			});
+
+			if (logModelLoads) {
+				size_t meshlets = 0;
+				for (auto& data : meshData) {
+					meshlets += data.meshlets.size();
+				}
+				std::cout << "Built " << meshlets << " meshlets for " << meshData.size() << " meshes of " << load->modelFile << std::endl;
+			}
+		}
+
+		for (auto& data : meshData) {
+			load->meshes.push_back(Mesh(geometryArena.get(), load->uploadBatch.get(), mainDevice.logicalDevice,
+				data.vertices.data(), static_cast<uint32_t>(data.vertices.size()),
+				data.indices.data(), static_cast<uint32_t>(data.indices.size()), data.texId, vertexFormat,
+				data.lods.data(), static_cast<uint32_t>(data.lods.size()), data.meshlets.data(), static_cast<uint32_t>(data.meshlets.size())));
+			load->meshNodes.push_back(data.node);
+		}
+
+		// Save converted geometry for next time (model still loads fine if this fails)
+		try {
+			MeshCache::write(load->modelFile, importFlags, processFlags, textureFiles, meshData, load->nodes);
 		}
+		catch (const std::exception& e) {
+			std::cout << e.what() << std::endl;
+		}
+	}
+	catch (const std::exception& e) {
+		load->failed = true;
+		load->error = e.what();
+	}
+
+	load->staged.store(true);
+}
+
+void Render::stageModelTextures(ModelLoad* load, const std::vector<std::string>& textureFiles) {
+	// Image i belongs to textureFiles[i], filled in whatever order decodes finish
+	load->images.resize(textureFiles.size(), VK_NULL_HANDLE);
+	load->imageMemory.resize(textureFiles.size());
+	load->imageMipLevels.resize(textureFiles.size(), 1);
+
+	struct DecodedTexture {
+		stbi_uc* pixels = nullptr;
+		int width = 0;
+		int height = 0;
+		VkDeviceSize size = 0;
+		double decodeMs = 0.0;
+		std::string error;
+	};
+	std::vector<DecodedTexture> decoded(textureFiles.size());
+
+	// Decode jobs report finished files here
+	std::mutex doneMutex;
+	std::condition_variable doneSignal;
+	std::deque<size_t> done;
+
+	for (size_t i = 0; i < textureFiles.size(); i++) {
+		decodePool->enqueue([&, i] {
+			auto start = std::chrono::steady_clock::now();
+			try {
+				decoded[i].pixels = loadTextureFile(textureFiles[i], &decoded[i].width, &decoded[i].height, &decoded[i].size);
+			}
+			catch (const std::exception& e) {
+				decoded[i].error = e.what();
+			}
+			decoded[i].decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			std::lock_guard<std::mutex> lock(doneMutex);
+			done.push_back(i);
+			doneSignal.notify_one();
+		});
+	}
+
+	// Stage each texture as soon as it is decoded. Every job is waited for, even after an error, since they use this stack frame
+	std::string error;
+	for (size_t finished = 0; finished < textureFiles.size(); finished++) {
+		size_t i;
+		{
+			std::unique_lock<std::mutex> lock(doneMutex);
+			doneSignal.wait(lock, [&] { return !done.empty(); });
+			i = done.front();
+			done.pop_front();
+		}
+
+		if (!decoded[i].error.empty()) {
+			error = decoded[i].error;
+			continue;
+		}
+
+		if (logModelLoads) {
+			std::cout << "Decoded texture " << textureFiles[i] << " (" << decoded[i].width << "x" << decoded[i].height
+				<< ") in " << decoded[i].decodeMs << " ms" << std::endl;
+		}
+
+		if (error.empty()) {
+			try {
+				load->images[i] = stageTexturePixels(decoded[i].pixels, decoded[i].width, decoded[i].height, decoded[i].size,
+					load->uploadBatch.get(), &load->imageMemory[i], &load->imageMipLevels[i]);
+			}
+			catch (const std::exception& e) {
+				error = e.what();
+			}
+		}
+		stbi_image_free(decoded[i].pixels);
+	}
+
+	if (!error.empty()) {
+		throw std::runtime_error(error);
+	}
+}
+
+void Render::updateModelLoads() {
+	for (auto it = modelLoads.begin(); it != modelLoads.end();) {
+		ModelLoad* load = it->get();
+
+		// Worker still busy
+		if (!load->staged.load()) {
+			++it;
+			continue;
+		}
+
+		if (load->failed) {
+			std::cout << "ERROR: " << load->error << std::endl;
+			destroyModelLoad(load);
+			modelStatus[load->modelId] = ModelStatus::Failed;
+			it = modelLoads.erase(it);
+			continue;
+		}
+
+		// Queues are only used from this thread, so loader threads leave the submit to us
+		if (!load->submitted) {
+			load->uploadBatch->submit();
+			load->submitted = true;
+		}
+
+		// Check timeline without blocking, model is drawn from the first frame after upload is done
+		if (load->uploadBatch->isComplete()) {
+			finishModelLoad(load);
+			if (load->failed) {
+				std::cout << "ERROR: " << load->error << std::endl;
+				destroyModelLoad(load);
+				modelStatus[load->modelId] = ModelStatus::Failed;
+			}
+			it = modelLoads.erase(it);
+			continue;
+		}
+
+		++it;
+	}
+}
+
+void Render::finishModelLoad(ModelLoad* load) {
+	// Model's meshes and every instance created while it was loading need transform slots
+	if (getTransformCount() + load->meshes.size() * (1 + modelInstances[load->modelId].size()) > MAX_DRAW_TRANSFORMS) {
+		load->failed = true;
+		load->error = "Failed to place model " + load->modelFile + ", transform buffer is full!";
+		return;
 	}
 
-	// Load in all our meshes
-	std::vector<Mesh> modelMeshes = MeshModel::LoadNode(mainDevice.physicalDevice, mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool,
-		scene->mRootNode, scene, matToTex);
+	// Upload is complete, so this only releases staging memory
+	load->uploadBatch->wait();
+	uploadWaitValue = std::max(uploadWaitValue, load->uploadBatch->getCompleteValue());
+
+	// Views and descriptor sets are created here, descriptor pool is not safe to use from loader threads
+	std::vector<int> imageToDescriptor(load->images.size());
+	for (size_t i = 0; i < load->images.size(); i++) {
+		textureImages.push_back(load->images[i]);
+		textureImageMemory.push_back(load->imageMemory[i]);
+		textureMipLevels.push_back(load->imageMipLevels[i]);
+
+		VkImageView imageView = createImageView(load->images[i], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, load->imageMipLevels[i]);
+		textureImageViews.push_back(imageView);
+
+		imageToDescriptor[i] = createTextureDescriptor(imageView);
+	}
+
+	// Meshes point at images of this load, switch them to descriptor sets
+	for (auto& mesh : load->meshes) {
+		int texId = mesh.getTexId();
+		mesh.setTexId(texId < 0 ? 0 : imageToDescriptor[texId]);
+	}
 
-	// Create mesh model and add to list
-	MeshModel meshModel = MeshModel(modelMeshes);
-	meshList.push_back(meshModel);
+	// Keep any transform set while model was pending
+	glm::mat4 model = meshList[load->modelId].getModel();
+	meshList[load->modelId] = MeshModel(load->meshes, load->nodes, load->meshNodes);
+	meshList[load->modelId].setModel(model);
+	modelStatus[load->modelId] = ModelStatus::Ready;
+	invalidateCommandBuffers();
+
+	load->images.clear();
+	load->imageMemory.clear();
+	load->imageMipLevels.clear();
+	load->meshes.clear();
+	load->meshNodes.clear();
+}
+
+void Render::destroyModelLoad(ModelLoad* load) {
+	// Batch may already be on the GPU, wait for it before freeing anything it writes to
+	if (load->uploadBatch) {
+		load->uploadBatch->wait();
+	}
+
+	for (size_t i = 0; i < load->images.size(); i++) {
+		vkDestroyImage(mainDevice.logicalDevice, load->images[i], nullptr);
+		memoryAllocator->free(load->imageMemory[i]);
+	}
+	for (auto& mesh : load->meshes) {
+		mesh.destroyBuffers();
+	}
 
-	return meshList.size() - 1;
+	load->images.clear();
+	load->imageMemory.clear();
+	load->imageMipLevels.clear();
+	load->meshes.clear();
 }
 
 
@@ -3,10 +3,18 @@
 #include <fstream>
 #include <GLFW/glfw3.h>
 
+#include <atomic>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 
+#include "DrawSort.h"
+#include "FrustumCull.h"
+#include "GeometryArena.h"
+#include "MemoryAllocator.h"
 #include "Mesh.h"
+#include "ThreadPool.h"
+#include "UploadBatch.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -18,6 +26,56 @@ const int MAX_FRAME_DRAWS = 30;
 
 const int MAX_OBJECTS = 20;
 
+// Threads decoding texture files (0 = one per hardware thread, minus the main thread)
+const uint32_t TEXTURE_DECODE_THREADS = 0;
+// Print timings and counts of each model load step (texture decodes, conversion, optimization, LODs, meshlets)
+const bool LOG_MODEL_LOADS = false;
+
+// Largest simplification error (in pixels on screen) a model's LOD may have
+const float LOD_PIXEL_ERROR = 1.0f;
+
+// Clip planes of the camera's projection, draws are also sorted front to back between them
+const float CAMERA_NEAR_PLANE = 0.1f;
+const float CAMERA_FAR_PLANE = 100.0f;
+
+// Capacity of the shared vertex/index buffers every Mesh is placed in
+const uint32_t MAX_GEOMETRY_VERTICES = 1 << 20;
+const uint32_t MAX_GEOMETRY_INDICES = 1 << 22;		// Counted as uint32 indices, twice as many uint16 ones fit
+const uint32_t MAX_GEOMETRY_MESHLETS = 1 << 16;
+
+// Meshlet culling limits per frame, meshes past them are drawn whole
+const uint32_t MAX_MESHLET_DRAWS = 1 << 16;			// Indirect draws the cull shader may write
+const uint32_t MAX_CULLED_MESHES = 1024;			// Meshes culled by meshlets (one draw count each)
+
+// Mesh transforms (one per model or instance copy of a mesh) written to the per image transform buffer each frame,
+// instances and loaded models that would not fit are refused
+const uint32_t MAX_DRAW_TRANSFORMS = 1 << 16;
+
+// Features below that are turned on fail to start without their compiled shader (compile_shaders.bat),
+// device limits turn them off instead
+
+// Keep recorded command buffers until models are added or removed (or a mesh changes LOD),
+// only works with transforms read from the transform buffer (needs Shaders/instanced_vert.spv)
+const bool REUSE_COMMAND_BUFFERS = true;
+
+// Mesh draw parameters (LOD range, copies) are written to a per image indirect buffer every frame and recorded as one
+// vkCmdDrawIndexedIndirect per run of draws sharing state (needs Shaders/instanced_vert.spv and drawIndirectFirstInstance)
+const bool INDIRECT_DRAWS = true;
+// Indirect draws go through a compute pass first that drops draws outside the frustum
+// (needs Shaders/draw_cull_comp.spv and draw count buffers)
+const bool GPU_FRUSTUM_CULLING = true;
+// Meshes outside the frustum are left out of the recording instead, tested on the CPU with SIMD every frame
+// (visibility changes record the command buffers again, so this suits small scenes; turns GPU frustum culling off)
+const bool CPU_FRUSTUM_CULLING = false;
+// GPU culled draws hidden behind the previous frame's depth (as a pyramid of farthest depths) are held back, and tested
+// again against a pyramid of this frame's first draws so nothing pops in (needs Shaders/depth_pyramid_comp.spv)
+const bool OCCLUSION_CULLING = true;
+
+// Threads recording mesh draws into secondary command buffers (0 = one per hardware thread, minus the main thread)
+const uint32_t RECORD_THREADS = 0;
+// Meshes per secondary command buffer, each one binds all of its state again so small chunks cost extra binds
+const uint32_t RECORD_CHUNK_MESHES = 256;
+
 namespace VKRENDER {
 
 	
@@ -34,6 +92,7 @@ namespace VKRENDER {
 	struct QueueFamilyIndices {
 		int graphicsFamily = -1;// Location of Graphics Queue Family
 		int presentationFamily = -1;		// Location of Presentation Queue Family
+		int transferFamily = -1;			// Location of Transfer Queue Family (transfer-only if possible, otherwise graphics)
 
 		// Check if queue families are valid
 		bool isValid() {
@@ -52,6 +111,50 @@ namespace VKRENDER {
 		VkImageView imageView;
 	};
 
+	// Load state of a model
+	enum class ModelStatus {
+		Pending,	// Loading on a worker thread or waiting for its GPU upload
+		Ready,		// Uploaded and drawn
+		Failed		// Load threw, model will never be drawn
+	};
+
+	// Settings of the renderer, fixed at creation (defaults are the constants above)
+	struct RenderOptions {
+		uint32_t textureDecodeThreads = TEXTURE_DECODE_THREADS;
+		bool logModelLoads = LOG_MODEL_LOADS;
+		bool reuseCommandBuffers = REUSE_COMMAND_BUFFERS;
+		uint32_t recordThreads = RECORD_THREADS;
+		uint32_t recordChunkMeshes = RECORD_CHUNK_MESHES;
+		bool indirectDraws = INDIRECT_DRAWS;
+		bool gpuFrustumCulling = GPU_FRUSTUM_CULLING;
+		bool cpuFrustumCulling = CPU_FRUSTUM_CULLING;
+		bool occlusionCulling = OCCLUSION_CULLING;
+	};
+
+	// Settings of one model load
+	struct ModelLoadOptions {
+		VertexFormat vertexFormat = VertexFormat::Full;	// Compact = quantized 12 byte vertices (needs Shaders/compact_vert.spv)
+		bool optimizeMeshes = true;						// Reorder triangles/vertices for GPU caches after import (result is cached)
+		bool generateLods = true;						// Build simplified detail levels after import (result is cached)
+		bool buildMeshlets = false;						// Split full detail into meshlets culled on the GPU (needs Shaders/cull_comp.spv, result is cached)
+	};
+
+	// Draws and binds of the last recorded command buffer
+	struct DrawStats {
+		uint32_t drawCount = 0;
+		uint32_t drawCallCount = 0;		// vkCmdDraw* calls recorded (indirect ones cover many draws)
+		uint32_t bindCount = 0;			// vkCmdBind* calls recorded
+		uint32_t bindsSaved = 0;		// Binds skipped because the draw before left the same state bound
+	};
+
+	// Mesh draws tested by frustum culling. GPU counts are read back without waiting (a few frames old)
+	struct CullStats {
+		uint32_t visibleCount = 0;
+		uint32_t culledCount = 0;		// No copy of the mesh inside the frustum
+		uint32_t occludedCount = 0;		// Inside the frustum, but hidden behind the depth pyramid (GPU only)
+		double nanosecondsPerObject = 0.0;	// CPU culling only, time of the batch test per mesh copy
+	};
+
 	static std::vector<char> readFile(const std::string& filename) {
 		std::ifstream file(filename, std::ios::binary | std::ios::ate);
 		if (!file.is_open()) {
@@ -69,11 +172,25 @@ namespace VKRENDER {
 	
 	class Render {
 	public:
-		Render(GLFWwindow* win);
+		Render(GLFWwindow* win, RenderOptions options = RenderOptions());
 		~Render();
 		void draw();
-		int createMeshModel(std::string modelFile);
+		int createMeshModel(std::string modelFile, ModelLoadOptions options = ModelLoadOptions());
+		// Returns model id straight away, loading and staging run on worker threads
+		int createMeshModelAsync(std::string modelFile, ModelLoadOptions options = ModelLoadOptions());
+		ModelStatus getModelStatus(int modelId);
 		void updateModel(int modelId, glm::mat4 newModel);
+		// Move one node of a model relative to its parent (node indices follow the file's hierarchy, depth first)
+		void updateModelNode(int modelId, uint32_t node, glm::mat4 localTransform);
+		// Draw another copy of a loaded (or loading) model, transform takes the model matrix's place. Returns instance id
+		// (throws if the copy's meshes don't fit in the transform buffer)
+		int createInstance(int modelId, glm::mat4 transform);
+		void updateInstance(int instanceId, glm::mat4 transform);
+		void removeInstance(int instanceId);
+		MemoryStats getMemoryStats();
+		// Recorded again only when the scene changes, frames reusing a recording issue no binds at all
+		DrawStats getDrawStats();
+		CullStats getCullStats();
 	private:
 		struct Device {
 			VkPhysicalDevice physicalDevice;
@@ -85,16 +202,138 @@ namespace VKRENDER {
 			glm::mat4 view;
 		} uboViewProjection;
 
+		// Counts the draw cull shader writes (visible, culled, occluded), CullStats as the GPU sees it
+		static const VkDeviceSize CULL_STATS_SIZE = sizeof(uint32_t) * 3;
+
+		// Camera data of the cull shaders
+		struct CullFrame {
+			glm::vec4 planes[6];			// Frustum planes in world space (xyz = normal pointing inside, w = distance)
+			glm::vec4 cameraPosition;
+			// Draw cull shader only (occlusion)
+			glm::mat4 viewProjection;
+			glm::mat4 previousViewProjection;	// The depth pyramid was built with it
+			glm::vec4 depthPyramid;			// Level 0 width, height, level count, 1 = built by the previous frame
+		};
+
+		// Per mesh push constants of the meshlet cull shader
+		struct CullPush {
+			uint32_t firstMeshlet;
+			uint32_t meshletCount;
+			uint32_t firstDraw;
+			uint32_t countIndex;
+			uint32_t transformSlot;		// Mesh's transform in the transform buffer (also the first instance of its draws)
+		};
+
+		// Push constants of the draw cull shader
+		struct DrawCullPush {
+			uint32_t drawCount;
+			uint32_t phase;					// 0 = early, 1 = late (occlusion culling only)
+			uint32_t phaseOffset;			// Late draws and counts start here
+		};
+
+		// Push constants of the depth pyramid shader, sizes of the level read and the level written
+		struct DepthPyramidPush {
+			uint32_t sourceWidth;
+			uint32_t sourceHeight;
+			uint32_t width;
+			uint32_t height;
+		};
+
+		// One mesh of a ready model, drawn once for the model and once per instance of it in a single instanced draw
+		struct MeshDraw {
+			uint32_t model;
+			uint32_t mesh;
+			uint32_t firstTransform;		// Slot of the model's copy, the instances' copies follow
+			uint32_t instanceCount;			// 1 + instances of the model
+		};
+
+		// Extra copy of a model
+		struct ModelInstance {
+			int modelId = -1;				// -1 = free instance id
+			uint32_t index;					// Position in modelInstances[modelId]
+			glm::mat4 transform;
+		};
+
+		// Secondary command buffers of one recording thread for one image (pool is only touched by that thread)
+		struct RecordContext {
+			VkCommandPool commandPool;
+			std::vector<VkCommandBuffer> commandBuffers;
+			size_t usedCount = 0;			// Buffers handed out since the pool was last reset
+		};
+
+		// Per sorted draw input of the draw cull shader (std430)
+		struct DrawCullInfo {
+			glm::vec4 sphere;				// Mesh space center, radius
+			uint32_t runStart;				// Sorted position of the draw's run: its draw count and output range (~0 = not culled here)
+			uint32_t padding[3];
+		};
+
+		// Model data produced off the main thread, finished on it once its GPU upload is done
+		struct ModelLoad {
+			int modelId;
+			std::string modelFile;
+			ModelLoadOptions options;
+			std::atomic<bool> staged{false};		// Worker is done with the load (check failed for result)
+			bool failed = false;
+			std::string error;
+			bool submitted = false;
+			std::unique_ptr<UploadBatch> uploadBatch;
+			std::vector<Mesh> meshes;				// Mesh texIds index into images (-1 = default texture)
+			NodeHierarchy nodes;
+			std::vector<uint32_t> meshNodes;		// 1:1 with meshes
+			std::vector<VkImage> images;
+			std::vector<MemoryAllocation> imageMemory;
+			std::vector<uint32_t> imageMipLevels;
+		};
+
 		// Scene Objects
 		std::vector<MeshModel> meshList;
+		std::vector<ModelStatus> modelStatus;	// 1:1 with meshList
+
+		// - Instances
+		std::vector<ModelInstance> instances;				// By instance id
+		std::vector<int> freeInstanceIds;
+		std::vector<std::vector<int>> modelInstances;		// Instance ids of each model, 1:1 with meshList
+
+		// - Draw Selection (redone every frame, ready models only)
+		std::vector<uint32_t> modelFirstDraw;		// Index of each model's first mesh draw, 1:1 with meshList
+		std::vector<MeshDraw> meshDraws;			// Ordered by transform slot
+		std::vector<uint32_t> meshLods;				// LOD per mesh draw (shared by all of its copies)
+		std::vector<uint32_t> recordedMeshLods;		// LODs the recorded command buffers draw (~0 = culled on the CPU)
+		std::vector<uint8_t> drawVisible;			// Per mesh draw, 0 = every copy outside the frustum
+		BoxBatch cullBoxes;							// World bounds per transform slot, for CPU culling
+		std::vector<uint8_t> cullBoxVisible;
+		std::vector<std::vector<uint64_t>> drawKeys;	// Sorted draw order each image was recorded with (draw index in the low bits)
+		std::vector<uint64_t> drawKeyScratch;
+		DrawStats drawStats;
+
+		// - Loading
+		std::unique_ptr<ThreadPool> loadPool;
+		std::unique_ptr<ThreadPool> decodePool;		// Separate from loadPool, model loads wait on their decodes and mesh conversions
+		uint32_t textureDecodeThreads;
+		bool logModelLoads;
+		std::vector<std::unique_ptr<ModelLoad>> modelLoads;
+
+		// - Recording
+		std::unique_ptr<ThreadPool> recordPool;
+		uint32_t recordThreads;
+		uint32_t recordChunkMeshes;
+		std::vector<std::vector<RecordContext>> recordContexts;		// [image][worker], last one is the main thread's
 
 		Device mainDevice;
+
+		// Pooled device memory all buffers and images are carved from
+		std::unique_ptr<MemoryAllocator> memoryAllocator;
+
+		// Shared vertex/index buffers all meshes live in
+		std::unique_ptr<GeometryArena> geometryArena;
 		
 		GLFWwindow* win;
 		VkInstance instance;
 
 		VkQueue graphicsQueue;
 		VkQueue presentationQueue;
+		VkQueue transferQueue;
 
 
 		VkSurfaceKHR surface;
@@ -102,6 +341,8 @@ namespace VKRENDER {
 		std::vector<SwapchainImage> swapChainImages;
 		std::vector<VkFramebuffer> swapChainFramebuffers;
 		std::vector<VkCommandBuffer> commandBuffers;
+		std::vector<bool> commandBufferRecorded;	// Still matches the scene, can be submitted again as is
+		bool reuseCommandBuffers;
 
 		VkSampler textureSampler;
 
@@ -121,27 +362,111 @@ namespace VKRENDER {
 		std::vector<VkDescriptorSet> inputDescriptorSets;
 
 		std::vector<VkBuffer> vpUniformBuffer;
-		std::vector<VkDeviceMemory> vpUniformBufferMemory;
+		std::vector<MemoryAllocation> vpUniformBufferMemory;
 
 		std::vector<VkBuffer> modelDUniformBuffer;
-		std::vector<VkDeviceMemory> modelDUniformBufferMemory;
+		std::vector<MemoryAllocation> modelDUniformBufferMemory;
+
+		// - Transforms (mat4 per mesh, instance rate vertex input of the draws and read by the cull shader)
+		std::vector<VkBuffer> transformBuffer;
+		std::vector<MemoryAllocation> transformBufferMemory;
+
+		// - Indirect Draws (VkDrawIndexedIndirectCommand per mesh draw, in the image's sorted draw order)
+		std::vector<VkBuffer> indirectDrawBuffer;
+		std::vector<MemoryAllocation> indirectDrawBufferMemory;
+
+		// - Draw Culling (CPU written draw infos, GPU written draws, run counts and stats)
+		VkDescriptorSetLayout drawCullSetLayout;
+		VkDescriptorPool drawCullDescriptorPool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> drawCullDescriptorSets;
+
+		std::vector<VkBuffer> drawCullInfoBuffer;
+		std::vector<MemoryAllocation> drawCullInfoBufferMemory;
+		std::vector<VkBuffer> culledDrawBuffer;				// Surviving draws, compacted to the front of each run's range
+		std::vector<MemoryAllocation> culledDrawBufferMemory;
+		std::vector<VkBuffer> culledCountBuffer;			// Draw count per run, at the run's start position (late phase from MAX_DRAW_TRANSFORMS on)
+		std::vector<MemoryAllocation> culledCountBufferMemory;
+		std::vector<VkBuffer> cullStatsBuffer;				// CULL_STATS_SIZE counts, host visible
+		std::vector<MemoryAllocation> cullStatsBufferMemory;
+		std::vector<VkBuffer> occludedDrawBuffer;			// Per sorted draw, held back by the early phase
+		std::vector<MemoryAllocation> occludedDrawBufferMemory;
+		std::vector<std::vector<uint32_t>> drawRunStarts;	// [image] DrawCullInfo::runStart per sorted draw, written when recording
+		CullStats cullStats;
+
+		// - Depth Pyramid (farthest depth per texel, level 0 is the largest power of two that fits in the swapchain extent).
+		// One for all images: built from each frame's early depth, read by the next frame's cull and the late phase
+		VkImage depthPyramidImage = VK_NULL_HANDLE;
+		MemoryAllocation depthPyramidImageMemory;
+		VkImageView depthPyramidImageView = VK_NULL_HANDLE;		// Every level, read by the draw cull shader
+		std::vector<VkImageView> depthPyramidLevelViews;		// One per level, written by the pyramid shader
+		uint32_t depthPyramidWidth = 1;
+		uint32_t depthPyramidHeight = 1;
+		uint32_t depthPyramidLevels = 1;
+		VkSampler depthPyramidSampler = VK_NULL_HANDLE;
+		VkDescriptorSetLayout depthPyramidSetLayout;
+		VkDescriptorPool depthPyramidDescriptorPool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> depthPyramidDescriptorSets;	// Level 0 from each image's depth buffer, then one per further level
+		glm::mat4 previousViewProjection = glm::mat4(1.0f);
+		bool depthPyramidBuilt = false;			// A submitted frame builds it, so the next one can test against it
+
+		// - Meshlet Culling (one set of buffers per image, written by the cull shader and read by the draws)
+		VkDescriptorSetLayout cullSetLayout;
+		VkDescriptorPool cullDescriptorPool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> cullDescriptorSets;
+
+		std::vector<VkBuffer> cullFrameBuffer;
+		std::vector<MemoryAllocation> cullFrameBufferMemory;
+		std::vector<VkBuffer> meshletDrawBuffer;			// VkDrawIndexedIndirectCommand list
+		std::vector<MemoryAllocation> meshletDrawBufferMemory;
+		std::vector<VkBuffer> meshletCountBuffer;			// Draw count per culled mesh
+		std::vector<MemoryAllocation> meshletCountBufferMemory;
 
 		// - Assets
 		std::vector<VkImage> textureImages;
-		std::vector<VkDeviceMemory> textureImageMemory;
+		std::vector<MemoryAllocation> textureImageMemory;
+		std::vector<uint32_t> textureMipLevels;
 		std::vector<VkImageView> textureImageViews;
 		
 		// - Pipeline
 		VkPipeline graphicsPipeline;
+		VkPipeline compactPipeline = VK_NULL_HANDLE;	// Same as graphicsPipeline but for CompactVertex meshes (null if shader is missing)
+		// Same as above, but the model matrix comes from the transform buffer (null if shader is missing)
+		VkPipeline instancedPipeline = VK_NULL_HANDLE;
+		VkPipeline compactInstancedPipeline = VK_NULL_HANDLE;
 		VkPipelineLayout pipelineLayout;
 		// Second shader
 		VkPipeline secondPipeline;
 		VkPipelineLayout secondPipelineLayout;
+		// Meshlet cull compute shader (null if shader is missing or draw counts can't be read from a buffer)
+		VkPipeline cullPipeline = VK_NULL_HANDLE;
+		VkPipelineLayout cullPipelineLayout;
+		bool drawIndirectCountSupported = false;
+		bool drawIndirectFirstInstanceSupported = false;
+		bool multiDrawIndirectSupported = false;
+		bool indirectDraws;
+		bool gpuFrustumCulling;
+		bool cpuFrustumCulling;
+		// Draw cull compute shader (null if culling is off or unavailable)
+		VkPipeline drawCullPipeline = VK_NULL_HANDLE;
+		VkPipelineLayout drawCullPipelineLayout;
+		bool occlusionCulling;
+		// Depth pyramid compute shader (null if occlusion culling is off or unavailable)
+		VkPipeline depthPyramidPipeline = VK_NULL_HANDLE;
+		VkPipelineLayout depthPyramidPipelineLayout;
 		
 		VkRenderPass renderPass;
+		// Occlusion culling splits renderPass around the depth pyramid build. Both are compatible with it,
+		// so they share its framebuffers, pipelines and secondary buffers
+		VkRenderPass earlyRenderPass = VK_NULL_HANDLE;		// Keeps colour and depth, draws nothing in the second subpass
+		VkRenderPass lateRenderPass = VK_NULL_HANDLE;		// Loads them back
 
 		// - Pools
 		VkCommandPool graphicsCommandPool;
+		VkCommandPool transferCommandPool;
+
+		// - Uploads
+		UploadContext uploadContext;
+		uint64_t uploadWaitValue = 0;		// Timeline value draws wait on, so uploaded resources are ready on first use
 
 		int currentFrame = 0;
 		
@@ -153,13 +478,14 @@ namespace VKRENDER {
 		std::vector<VkSemaphore> imageAvailable;
 		std::vector<VkSemaphore> renderFinished;
 		std::vector<VkFence> drawFences;
+		std::vector<VkFence> imagesInFlight;				// Draw fence of the last submit per swap chain image (null until first draw)
 
 		std::vector<VkImage> colourBufferImage;
-		std::vector<VkDeviceMemory> colourBufferImageMemory;
+		std::vector<MemoryAllocation> colourBufferImageMemory;
 		std::vector<VkImageView> colourBufferImageView;
 
 		std::vector<VkImage> depthBufferImage;
-		std::vector<VkDeviceMemory> depthBufferImageMemory;
+		std::vector<MemoryAllocation> depthBufferImageMemory;
 		std::vector<VkImageView> depthBufferImageView;
 
 		void init();
@@ -172,22 +498,33 @@ namespace VKRENDER {
 		bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 
 		void createLogicalDevice();
+		void createMemoryAllocator();
+		void createGeometryArena();
 		void createSurface();
 		void createSwapChain();
 		void createRenderPass();
 		void createDescriptorSetLayout();
 		void createPushConstantRange();
 		void createGraphicsPipeline();
+		void createCullPipeline();
+		void createDrawCullPipeline();
+		void createDepthPyramidPipeline();
 		void createColourBufferImage();
 		void createFramebuffers();
 		void createCommandPool();
 		void createCommandBuffers();
+		void createRecordContexts();
 		void createSynchronisation();
+		void createUploadContext();
 		void createTextureSampler();
 
 		void createUniformBuffers();
+		void createTransformBuffers();
 		void createDescriptorPool();
 		void createDescriptorSets();
+		void createCullResources();
+		void createDepthPyramid();
+		void createDrawCullResources();
 
 		void createInputDescriptorSets();
 		
@@ -196,7 +533,16 @@ namespace VKRENDER {
 		void createDepthBufferImage();
 		
 		
-		void recordCommands(uint32_t currentImage);
+		void selectMeshLods();
+		void cullMeshDraws();
+		void invalidateCommandBuffers();
+		VkPipeline getMeshPipeline(VertexFormat vertexFormat);
+		void recordCommands(uint32_t currentImage);				// Image's last submit must have finished (see imagesInFlight)
+		DrawStats recordMeshDraws(VkCommandBuffer commandBuffer, uint32_t currentImage, size_t firstDraw, size_t endDraw,
+			const std::vector<CullPush>& cullPushes, const std::vector<int>& drawCullBatches, uint32_t phase);
+		glm::mat4 getInstanceTransform(const MeshDraw& meshDraw, uint32_t instance);
+		uint32_t getDrawLimit();
+		size_t getTransformCount();
 
 		// -- Getter Functions
 		QueueFamilyIndices getQueueFamilies(VkPhysicalDevice device);
@@ -210,13 +556,23 @@ namespace VKRENDER {
 
 		// -- Create Functions
 		VkImage createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags,
-			VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory);
-		VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+			VkMemoryPropertyFlags propFlags, MemoryAllocation* imageMemory, uint32_t mipLevels = 1);
+		VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels = 1, uint32_t baseMipLevel = 0);
 		VkShaderModule createShaderModule(const std::vector<char>& code);
 
 		int createTextureImage(std::string fileName);
+		VkImage stageTextureImage(std::string fileName, UploadBatch* uploadBatch, MemoryAllocation* imageMemory, uint32_t* mipLevels);
+		VkImage stageTexturePixels(unsigned char* imageData, int width, int height, VkDeviceSize imageSize,
+			UploadBatch* uploadBatch, MemoryAllocation* imageMemory, uint32_t* mipLevels);
 		int createTexture(std::string fileName);
 		int createTextureDescriptor(VkImageView textureImage);
+
+		// -- Model Loading
+		void loadModel(ModelLoad* load);
+		void stageModelTextures(ModelLoad* load, const std::vector<std::string>& textureFiles);
+		void updateModelLoads();
+		void finishModelLoad(ModelLoad* load);
+		void destroyModelLoad(ModelLoad* load);
 		
 	};
 